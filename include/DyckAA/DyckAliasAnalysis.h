@@ -20,6 +20,7 @@
 #define DYCKAA_DYCKALIASANALYSIS_H
 
 #include <llvm/Pass.h>
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/Support/ErrorHandling.h>
@@ -31,6 +32,7 @@
 #include "DyckAA/DyckCallGraph.h"
 #include "DyckAA/DyckGraphEdgeLabel.h"
 #include "DyckAA/DyckGraph.h"
+#include <memory>
 
 using namespace llvm;
 
@@ -39,13 +41,33 @@ extern cl::opt<std::string> PrintCSourceFunctions;
 extern cl::opt<std::string> PrintCSinkFunctions;
 extern cl::opt<std::string> CSourceFunctions;
 extern cl::opt<std::string> CSinkFunctions;
+
+class ModuleNumbering;
+
 class DyckAliasAnalysis : public ModulePass {
 private:
     DyckGraph *DyckPTG;
     DyckCallGraph *DyckCG;
 
+    /// the analyzed module and its numbering, which is built on demand, so that the bitcode of the module
+    /// is hashed at most once for all the files that refer to its values by numbers
+    /// @{
+    Module *Mod = nullptr;
+    std::unique_ptr<ModuleNumbering> Numbering;
+    /// @}
+
+    /// a read-only view of the alias classes, which is built once the analysis finishes,
+    /// so that queries neither allocate nor change the graph, and can be issued from multiple threads
+    /// @{
+    /// value -> the dense id of its alias class
+    DenseMap<const Value *, unsigned> ClassIDs;
+    /// class id -> the vertex of the class
+    std::vector<DyckGraphNode *> ClassVertices;
+    /// @}
+
 public:
     static char ID;
+    static const unsigned InvalidClassID = ~0U;
     bool analysisC = true;
     DyckAliasAnalysis();
 
@@ -55,12 +77,24 @@ public:
 
     void getAnalysisUsage(AnalysisUsage &AU) const override;
 
-    /// get alias set of a pointer \p Ptr
+    /// get alias set of a pointer \p Ptr, return null if the pointer is not analyzed
     const std::set<Value *> *getAliasSet(Value *Ptr) const;
 
+    /// get the dense id of the alias class of \p V in [0, numAliasClasses()), return InvalidClassID if
+    /// \p V is not analyzed
+    unsigned getAliasClassID(const Value *V) const {
+        auto It = ClassIDs.find(V);
+        return It == ClassIDs.end() ? InvalidClassID : It->second;
+    }
+
+    unsigned numAliasClasses() const { return ClassVertices.size(); }
+
     /// return true if \p V1 is an alias of \p V2
     bool mayAlias(Value *V1, Value *V2) const;
 
+    /// set \p Results[K] to whether the values of \p Pairs[K] may alias
+    void mayAlias(ArrayRef<std::pair<Value *, Value *>> Pairs, SmallVectorImpl<bool> &Results) const;
+
     /// return true if \p V is an alias of nullptr
     bool mayNull(Value *V) const;
 
@@ -70,7 +104,13 @@ public:
     /// get the dyck-cfl graph
     DyckGraph *getDyckGraph() const;
 
+    /// get the numbering of the analyzed module
+    const ModuleNumbering &getModuleNumbering();
+
 private:
+    /// number the alias classes and map each analyzed value to its class
+    void buildAliasClasses();
+
     /// Three kinds of information will be printed.
     /// 1. Alias Sets will be printed to the console
     /// 2. The relation of Alias Sets will be output into "alias_rel.dot"
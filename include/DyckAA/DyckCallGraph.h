@@ -31,6 +31,7 @@
 #include <llvm/IR/GetElementPtrTypeIterator.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/Pass.h>
+#include <llvm/Support/Allocator.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/ErrorHandling.h>
 #include <llvm/Support/raw_ostream.h>
@@ -50,6 +51,8 @@ typedef std::map<Function *, DyckCallGraphNode *> FunctionMapTy;
 typedef std::map<int, const Call *> CallSiteMapTy;
 class DyckCallGraph {
 private:
+    /// the arena of the nodes and the calls, which are released as a whole with the call graph
+    BumpPtrAllocator Allocator;
     /// function -> call graph node
     FunctionMapTy FunctionMap;
     /// CallSite ID -> CallSite(Call Instruction)
@@ -95,9 +98,20 @@ public:
 
     DyckCallGraphNode *getFunction(Function *) const;
 
+    /// create a call in the arena of the call graph, the call is released with the call graph
+    /// @{
+    CommonCall *createCommonCall(Instruction *Inst, Function *Func, std::vector<Value *> *Args);
+
+    PointerCall *createPointerCall(Instruction *Inst, Value *CalledValue, std::vector<Value *> *Args);
+    /// @}
+
+    /// the arena that the call graph allocates from, for reporting its memory usage
+    const BumpPtrAllocator &getAllocator() const { return Allocator; }
+
     void constructCallSiteMap();
-    const Call *getCallSite(int id) {
-        return CallSiteMap[id];
+    const Call *getCallSite(int id) const {
+        auto It = CallSiteMap.find(id);
+        return It == CallSiteMap.end() ? nullptr : It->second;
     }
 
     void dotCallGraph(const std::string &ModuleIdentifier);
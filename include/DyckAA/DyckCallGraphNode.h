@@ -132,7 +132,7 @@ private:
     std::vector<Value *> Args;
     std::vector<Value *> VAArgs;
 
-    /// call instructions in the function
+    /// call instructions in the function, the calls are owned by the call graph
     /// @{
     std::set<CommonCall *> CommonCalls;
     std::set<PointerCall *> PointerCalls;
@@ -143,8 +143,6 @@ private:
 public:
     explicit DyckCallGraphNode(Function *);
 
-    ~DyckCallGraphNode();
-
     Function *getLLVMFunction();
 
     void addCommonCall(CommonCall *);
@@ -19,26 +19,172 @@
 #ifndef DYCKAA_DYCKHALFGRAPH_H
 #define DYCKAA_DYCKHALFGRAPH_H
 
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallBitVector.h>
+#include <llvm/ADT/iterator_range.h>
+#include <llvm/Support/Allocator.h>
 #include "DyckAA/DyckGraphNode.h"
+#include "Support/DisjointSet.h"
 
 class DyckGraphEdgeLabel;
 
+/// Iterate the live vertices of a DyckGraph, skipping the slots of merged vertices.
+class DyckGraphNodeIterator {
+private:
+    std::vector<DyckGraphNode *>::const_iterator It;
+    std::vector<DyckGraphNode *>::const_iterator End;
+
+    void skip() { while (It != End && !*It) ++It; }
+
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef DyckGraphNode *value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef DyckGraphNode *const *pointer;
+    typedef DyckGraphNode *const &reference;
+
+    DyckGraphNodeIterator(std::vector<DyckGraphNode *>::const_iterator It,
+                          std::vector<DyckGraphNode *>::const_iterator End) : It(It), End(End) { skip(); }
+
+    reference operator*() const { return *It; }
+
+    DyckGraphNodeIterator &operator++() {
+        ++It;
+        skip();
+        return *this;
+    }
+
+    DyckGraphNodeIterator operator++(int) {
+        DyckGraphNodeIterator Old(*this);
+        ++(*this);
+        return Old;
+    }
+
+    bool operator==(const DyckGraphNodeIterator &Other) const { return It == Other.It; }
+
+    bool operator!=(const DyckGraphNodeIterator &Other) const { return It != Other.It; }
+};
+
+/// The pending (vertex, label) pairs of qirun's algorithm, i.e., the vertex has more than one target with the label.
+/// Membership is a per-vertex bitmap over label ids, so that both query and removal take O(1) time.
+/// Pairs are visited in FIFO order, and removed pairs are dropped lazily when they reach the front of the queue.
+class DyckGraphWorklist {
+private:
+    /// (vertex index, label), vertices are referred to by indices because a vertex may be deleted after merging
+    std::deque<std::pair<unsigned, DyckGraphEdgeLabel *>> Queue;
+
+    /// vertex index -> ids of the pending labels
+    std::vector<llvm::SmallBitVector> Pending;
+
+    size_t NumPending = 0;
+
+    unsigned long NumPushes = 0;
+
+    unsigned long NumPops = 0;
+
+public:
+    bool empty() const { return NumPending == 0; }
+
+    bool contains(unsigned Node, DyckGraphEdgeLabel *Label) const {
+        unsigned ID = Label->getLabelID();
+        return Node < Pending.size() && ID < Pending[Node].size() && Pending[Node].test(ID);
+    }
+
+    /// add a pair if it is not in the worklist
+    void push(unsigned Node, DyckGraphEdgeLabel *Label) {
+        unsigned ID = Label->getLabelID();
+        if (Node >= Pending.size()) Pending.resize(Node + 1);
+        if (ID >= Pending[Node].size()) Pending[Node].resize(ID + 1);
+        if (Pending[Node].test(ID)) return;
+        Pending[Node].set(ID);
+        Queue.emplace_back(Node, Label);
+        ++NumPending;
+        ++NumPushes;
+    }
+
+    void remove(unsigned Node, DyckGraphEdgeLabel *Label) {
+        if (!contains(Node, Label)) return;
+        Pending[Node].reset(Label->getLabelID());
+        --NumPending;
+        ++NumPops;
+    }
+
+    /// the oldest pending pair, which is kept in the worklist until it is removed
+    const std::pair<unsigned, DyckGraphEdgeLabel *> &front() {
+        assert(!empty());
+        while (!contains(Queue.front().first, Queue.front().second)) Queue.pop_front();
+        return Queue.front();
+    }
+
+    unsigned long numPushes() const { return NumPushes; }
+
+    unsigned long numPops() const { return NumPops; }
+};
+
 /// This class models a dyck-cfl language as a graph, which does not contain the barred edges.
 /// See details in http://dl.acm.org/citation.cfm?id=2491956.2462159&coll=DL&dl=ACM&CFID=379446910&CFTOKEN=65130716 .
 class DyckGraph {
+    friend class DyckGraphNode;
+    friend class DyckAACache;
 private:
-    std::set<DyckGraphNode *> Vertices;
+    /// the arena of the vertices, the edge labels and the chunks of the equivalent sets
+    /// a merged vertex is destroyed in place, and the memory is released only when the graph is destroyed
+    llvm::BumpPtrAllocator Allocator;
+
+    /// vertex index -> vertex, the slot of a vertex is reset to null after it is merged into another one
+    std::vector<DyckGraphNode *> Vertices;
 
-    std::unordered_map<llvm::Value *, DyckGraphNode *> ValVertexMap;
+    /// the number of non-null slots in Vertices
+    unsigned NumLiveVertices;
+
+    /// value -> index of the vertex created for the value
+    /// in the union-find mode, the entry is not updated after merging, and
+    /// the current vertex is the representative of the index in Classes
+    std::unordered_map<llvm::Value *, unsigned> ValVertexMap;
+
+    /// vertex index -> the index of the vertex it has been merged into
+    IndexDisjointSet Classes;
+
+    /// the (vertex, label) pairs with more than one target, which are to be unified by qirun's algorithm
+    /// a pair is added once the vertex gets its second target with the label, so that
+    /// qirun's algorithm only visits the part of the graph changed since its last run
+    DyckGraphWorklist Pending;
 
     /// edge labels
     /// @{
+    unsigned NumEdgeLabels;
     DyckGraphEdgeLabel *DerefEdgeLabel;
     std::map<long, DyckGraphEdgeLabel *> OffsetEdgeLabelMap;
     std::map<long, DyckGraphEdgeLabel *> IndexEdgeLabelMap;
     /// @}
 
+    /// fields
+    /// the offset (or index) edges of a vertex are collapsed into one edge labeled with the collapsed label
+    /// @{
+    DyckGraphEdgeLabel *CollapsedOffsetEdgeLabel = nullptr;
+    DyckGraphEdgeLabel *CollapsedIndexEdgeLabel = nullptr;
+    unsigned MaxFields = 0;
+    unsigned FieldStride = 0;
+    unsigned NumCollapsedVertices = 0;
+    /// @}
+
+    /// memoized closures of the final graph
+    /// vertex index -> the vertices reachable from the vertex, the slots are allocated on the first query
+    /// and filled by whichever thread computes a closure first
+    /// @{
+    std::unique_ptr<std::atomic<const std::vector<DyckGraphNode *> *>[]> Closures;
+    unsigned NumClosureSlots = 0;
+    std::atomic<bool> HasClosures{false};
+    std::mutex ClosureMutex;
+    /// @}
+
 public:
     DyckGraph();
 
@@ -47,12 +193,21 @@ public:
     /// The number of vertices in the graph.
     unsigned int numVertices();
 
+    /// The arena that the graph allocates from, for reporting its memory usage.
+    const llvm::BumpPtrAllocator &getAllocator() const { return Allocator; }
+
     /// The number of equivalent sets.
     /// Please use it after you call void qirunAlgorithm().
     unsigned int numEquivalentClasses();
 
-    /// Get the set of vertices in the graph.
-    std::set<DyckGraphNode *> &getVertices();
+    /// Get the vertices in the graph, in the order of their indices.
+    llvm::iterator_range<DyckGraphNodeIterator> getVertices() const;
+
+    /// Get the vertex by its index, return null if it has been merged into another vertex.
+    DyckGraphNode *getVertex(unsigned Index) const { return Index < Vertices.size() ? Vertices[Index] : nullptr; }
+
+    /// Get the vertex that the vertex with the index has been merged into.
+    DyckGraphNode *getRepVertex(unsigned Index);
 
     /// You are not recommended to use the function when the graph is big,
     /// because it is time-consuming.
@@ -69,11 +224,31 @@ public:
 
     DyckGraphNode *findDyckVertex(llvm::Value *Val);
 
+    /// Return true if findDyckVertex does not write, so that it can be called from multiple threads,
+    /// which holds once qirunAlgorithm() has flattened the union-find.
+    bool hasReadOnlyLookups() const { return Classes.isFlat(); }
+
+    /// Map a value that has no vertex to an existing vertex, instead of creating a vertex for the value
+    /// and merging it into the existing one later.
+    void substituteDyckVertex(llvm::Value *Val, DyckGraphNode *Node);
+
     /// Get reachable nodes
     /// @{
     void getReachableVertices(const std::set<DyckGraphNode *> &Sources, std::set<DyckGraphNode *> &Reachable);
 
     void getReachableVertices(DyckGraphNode *Source, std::set<DyckGraphNode *> &Reachable);
+
+    /// Append the vertices reachable from the sources, including themselves, in the order they are visited.
+    /// The traversal marks vertices in a bitset over vertex indices, which is a scratch buffer of the thread,
+    /// and does not expand a vertex whose closure has been memoized. It is safe to call it from multiple threads.
+    void getReachableVertices(llvm::ArrayRef<DyckGraphNode *> Sources, std::vector<DyckGraphNode *> &Reachable);
+
+    /// The vertices reachable from the vertex, including itself, which are computed once and shared by the
+    /// following traversals. It is safe to call it from multiple threads, but the graph must not change until
+    /// the closures are cleared.
+    const std::vector<DyckGraphNode *> &getReachableClosure(DyckGraphNode *Source);
+
+    void clearReachableClosures();
     /// @}
 
     /// The algorithm proposed by Qirun Zhang.
@@ -82,6 +257,13 @@ public:
     /// If the function does nothing, return true, otherwise return false.
     bool qirunAlgorithm();
 
+    /// The total number of (vertex, label) pairs pushed into/popped from the worklist of qirun's algorithm.
+    /// @{
+    unsigned long numWorklistPushes() const { return Pending.numPushes(); }
+
+    unsigned long numWorklistPops() const { return Pending.numPops(); }
+    /// @}
+
     /// validation
     void validation(const char *, int);
 
@@ -89,12 +271,38 @@ public:
 
     DyckGraphEdgeLabel *getOrInsertIndexEdgeLabel(long Offset);
 
+    /// Get the label of an offset (or index, if \p Ty is LT_Index) edge from \p Src to its field \p Field.
+    /// It is the collapsed label, which stands for all the fields of \p Src, if the fields of \p Src have been
+    /// collapsed, or if the new field makes them exceed the limits set by setFieldLimits.
+    DyckGraphEdgeLabel *getOrInsertFieldEdgeLabel(DyckGraphNode *Src, DyckGraphEdgeLabel::LabelType Ty, long Field);
+
+    /// Collapse the fields of a vertex once it has more than \p MaxFields offsets (or indices), or once
+    /// \p FieldStride of them are evenly spaced, e.g., the elements of an array accessed with constant indices.
+    /// Zero means no limit.
+    void setFieldLimits(unsigned MaxFields, unsigned FieldStride) {
+        this->MaxFields = MaxFields;
+        this->FieldStride = FieldStride;
+    }
+
+    /// The number of vertices whose fields have been collapsed.
+    unsigned numCollapsedVertices() const { return NumCollapsedVertices; }
+
     DyckGraphEdgeLabel *getDereferenceEdgeLabel() const { return DerefEdgeLabel; }
 
 private:
-    void removeFromWorkList(std::multimap<DyckGraphNode *, DyckGraphEdgeLabel *> &, DyckGraphNode *, DyckGraphEdgeLabel *);
+    /// Move y's edges and values to x, and delete y.
+    void mergeVertices(DyckGraphNode *X, DyckGraphNode *Y);
+
+    DyckGraphEdgeLabel *getCollapsedEdgeLabel(DyckGraphEdgeLabel::LabelType Ty);
+
+    bool isCollapsed(DyckGraphNode *Src, DyckGraphEdgeLabel::LabelType Ty) const;
+
+    /// return true if adding the field to the vertex, if it is not null, makes the fields exceed the limits
+    bool exceedsFieldLimits(DyckGraphNode *Src, DyckGraphEdgeLabel::LabelType Ty, const long *Field) const;
 
-    bool containsInWorkList(std::multimap<DyckGraphNode *, DyckGraphEdgeLabel *> &, DyckGraphNode *, DyckGraphEdgeLabel *);
+    /// move the targets of the offset (or index) edges of the vertex to its collapsed edge,
+    /// so that qirun's algorithm unifies all the fields of the vertex
+    void collapseEdges(DyckGraphNode *Src, DyckGraphEdgeLabel::LabelType Ty);
 };
 
 #endif // DYCKAA_DYCKHALFGRAPH_H
@@ -19,10 +19,12 @@
 #ifndef DYCKAA_DYCKGRAPHEDGELABEL_H
 #define DYCKAA_DYCKGRAPHEDGELABEL_H
 
+#include <climits>
 #include <string>
 #include <map>
 
 class DyckGraphEdgeLabel {
+    friend class DyckGraph;
 public:
     enum LabelType {
         LT_Dereference, LT_Offset, LT_Index
@@ -31,7 +33,12 @@ public:
 private:
     std::string Desc;
 
+    /// a dense id assigned by the graph that creates the label
+    unsigned LabelID = 0;
+
 public:
+    unsigned getLabelID() const { return LabelID; }
+
     virtual std::string &getEdgeLabelDescription() { return Desc; }
 
     virtual bool isLabelTy(LabelType type) { return false; }
@@ -55,10 +62,17 @@ private:
     long OffsetBytes;
 
 public:
+    /// the offset of the label that stands for all the offsets of a vertex whose offset edges are collapsed
+    static const long AnyOffset = LONG_MIN;
+
     explicit PointerOffsetEdgeLabel(long Bytes) : OffsetBytes(Bytes) {
         std::string &Desc = DyckGraphEdgeLabel::getEdgeLabelDescription();
         Desc.clear();
         Desc.append("@");
+        if (Bytes == AnyOffset) {
+            Desc.append("*");
+            return;
+        }
 
         char Temp[1024];
         sprintf(Temp, "%ld", Bytes);
@@ -75,10 +89,17 @@ private:
     long FieldIndex;
 
 public:
+    /// the index of the label that stands for all the fields of a vertex whose index edges are collapsed
+    static const long AnyIndex = LONG_MIN;
+
     explicit FieldIndexEdgeLabel(long Idx) : FieldIndex(Idx) {
         std::string &Desc = DyckGraphEdgeLabel::getEdgeLabelDescription();
         Desc.clear();
         Desc.append("#");
+        if (Idx == AnyIndex) {
+            Desc.append("*");
+            return;
+        }
 
         char Temp[1024];
         sprintf(Temp, "%ld", Idx);
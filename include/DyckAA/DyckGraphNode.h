@@ -20,33 +20,261 @@
 #define DYCKAA_DYCKGRAPHNODE_H
 
 #include "DyckAA/DyckGraphEdgeLabel.h"
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
 #include <set>
+#include <utility>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/Value.h>
+#include <llvm/Support/Allocator.h>
 class DyckGraph;
+class DyckGraphNode;
+
+/// A set of dyck vertices stored as a small sorted vector.
+/// After unification, a vertex has at most one target per label, so the elements almost always live inline.
+class DyckGraphNodeSet {
+private:
+    typedef llvm::SmallVector<DyckGraphNode *, 2> StorageTy;
+    StorageTy Nodes;
+
+public:
+    typedef StorageTy::const_iterator iterator;
+    typedef StorageTy::const_iterator const_iterator;
+
+    iterator begin() const { return Nodes.begin(); }
+
+    iterator end() const { return Nodes.end(); }
+
+    size_t size() const { return Nodes.size(); }
+
+    bool empty() const { return Nodes.empty(); }
+
+    size_t count(DyckGraphNode *N) const { return std::binary_search(Nodes.begin(), Nodes.end(), N); }
+
+    /// return true if \p N is newly inserted
+    bool insert(DyckGraphNode *N) {
+        auto It = std::lower_bound(Nodes.begin(), Nodes.end(), N);
+        if (It != Nodes.end() && *It == N) return false;
+        Nodes.insert(It, N);
+        return true;
+    }
+
+    /// return true if \p N is removed
+    bool erase(DyckGraphNode *N) {
+        auto It = std::lower_bound(Nodes.begin(), Nodes.end(), N);
+        if (It == Nodes.end() || *It != N) return false;
+        Nodes.erase(It);
+        return true;
+    }
+
+    void clear() { Nodes.clear(); }
+
+    void swap(DyckGraphNodeSet &Other) { Nodes.swap(Other.Nodes); }
+};
+
+/// The values of an equivalence class, stored as a singly-linked list of chunks.
+/// A value is in one class only, so two lists are merged by splicing them in O(1) time, without looking for duplicates.
+/// The values are in the order they are added, and the chunks of a spliced list may be partially filled.
+/// The chunks are allocated from the arena of the graph, and are released with the arena rather than the list.
+class DyckEquivalentValues {
+private:
+    static const unsigned ChunkCapacity = 4;
+
+    struct Chunk {
+        Chunk *Next = nullptr;
+        unsigned Size = 0;
+        llvm::Value *Values[ChunkCapacity];
+    };
+
+    Chunk *Head = nullptr;
+    Chunk *Tail = nullptr;
+    size_t NumValues = 0;
+
+public:
+    class iterator {
+    private:
+        const Chunk *C;
+        unsigned K;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef llvm::Value *value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef llvm::Value *const *pointer;
+        typedef llvm::Value *const &reference;
+
+        iterator(const Chunk *C, unsigned K) : C(C), K(K) {}
+
+        reference operator*() const { return C->Values[K]; }
+
+        iterator &operator++() {
+            if (++K == C->Size) {
+                // a spliced list has no empty chunks
+                C = C->Next;
+                K = 0;
+            }
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator Old(*this);
+            ++(*this);
+            return Old;
+        }
+
+        bool operator==(const iterator &Other) const { return C == Other.C && K == Other.K; }
+
+        bool operator!=(const iterator &Other) const { return !(*this == Other); }
+    };
+
+    DyckEquivalentValues() = default;
+
+    DyckEquivalentValues(const DyckEquivalentValues &) = delete;
+
+    DyckEquivalentValues &operator=(const DyckEquivalentValues &) = delete;
+
+    iterator begin() const { return {Head, 0}; }
+
+    iterator end() const { return {nullptr, 0}; }
+
+    size_t size() const { return NumValues; }
+
+    bool empty() const { return NumValues == 0; }
+
+    void push_back(llvm::Value *V, llvm::BumpPtrAllocator &Allocator) {
+        if (!Tail || Tail->Size == ChunkCapacity) {
+            auto *C = new (Allocator.Allocate<Chunk>()) Chunk;
+            (Tail ? Tail->Next : Head) = C;
+            Tail = C;
+        }
+        Tail->Values[Tail->Size++] = V;
+        ++NumValues;
+    }
+
+    /// move the values of \p Other to the end of this list, both lists must use the same arena
+    void splice(DyckEquivalentValues &Other) {
+        if (Other.empty()) return;
+        (Tail ? Tail->Next : Head) = Other.Head;
+        Tail = Other.Tail;
+        NumValues += Other.NumValues;
+        Other.Head = Other.Tail = nullptr;
+        Other.NumValues = 0;
+    }
+};
+
+/// Label -> vertices, stored as a small vector sorted by the label.
+/// Entries are never removed, even if their vertex sets become empty, so that
+/// iterating the map is not affected by removing edges.
+class DyckGraphEdgeMap {
+public:
+    typedef std::pair<DyckGraphEdgeLabel *, DyckGraphNodeSet> value_type;
+
+private:
+    typedef llvm::SmallVector<value_type, 1> StorageTy;
+    StorageTy Edges;
+
+    static bool lessThan(const value_type &Entry, DyckGraphEdgeLabel *Label) { return Entry.first < Label; }
+
+public:
+    typedef StorageTy::iterator iterator;
+    typedef StorageTy::const_iterator const_iterator;
+
+    iterator begin() { return Edges.begin(); }
+
+    iterator end() { return Edges.end(); }
+
+    const_iterator begin() const { return Edges.begin(); }
+
+    const_iterator end() const { return Edges.end(); }
+
+    size_t size() const { return Edges.size(); }
+
+    bool empty() const { return Edges.empty(); }
+
+    iterator find(DyckGraphEdgeLabel *Label) {
+        auto It = std::lower_bound(Edges.begin(), Edges.end(), Label, lessThan);
+        if (It != Edges.end() && It->first == Label) return It;
+        return Edges.end();
+    }
+
+    const_iterator find(DyckGraphEdgeLabel *Label) const {
+        auto It = std::lower_bound(Edges.begin(), Edges.end(), Label, lessThan);
+        if (It != Edges.end() && It->first == Label) return It;
+        return Edges.end();
+    }
+
+    /// get or insert the vertex set of a label
+    /// note that inserting a new label invalidates references to other entries
+    DyckGraphNodeSet &operator[](DyckGraphEdgeLabel *Label) {
+        auto It = std::lower_bound(Edges.begin(), Edges.end(), Label, lessThan);
+        if (It == Edges.end() || It->first != Label)
+            It = Edges.insert(It, value_type(Label, DyckGraphNodeSet()));
+        return It->second;
+    }
+};
+
+/// The offsets (or indices) a vertex has edges for, summarized by their number, range and the gcd of their
+/// distances, which is updated in O(1) time for each new field, i.e., the fields are never enumerated.
+struct DyckFieldSummary {
+    unsigned NumFields = 0;
+    long Min = 0;
+    long Max = 0;
+    unsigned long Stride = 0;
+
+    void add(long Field) {
+        if (NumFields++ == 0) {
+            Min = Max = Field;
+            return;
+        }
+        // every distance to the new minimum is a distance to the old one plus their distance
+        unsigned long Distance = Field < Min ? (unsigned long) Min - Field : (unsigned long) Field - Min;
+        while (Distance) {
+            unsigned long Remainder = Stride % Distance;
+            Stride = Distance;
+            Distance = Remainder;
+        }
+        Min = std::min(Min, Field);
+        Max = std::max(Max, Field);
+    }
+
+    /// return true if there are at least two fields, and no gaps between them, e.g., the elements of an array
+    bool isEvenlySpaced() const {
+        return NumFields > 1 && Stride && ((unsigned long) Max - Min) / Stride + 1 == NumFields;
+    }
+};
 
 class DyckGraphNode {
     friend class DyckGraph;
 private:
-    static int GlobalNodeIndex;
+    DyckGraph *Graph;
     int NodeIndex;
     const char *NodeName;
     bool ContainsNull = false;
     bool AliasOfHeapAlloc = false;
     bool AliasOfDealloc = false;
-    std::set<DyckGraphEdgeLabel *> InLables;
-    std::set<DyckGraphEdgeLabel *> OutLables;
 
-    std::map<DyckGraphEdgeLabel *, std::set<DyckGraphNode *>> InNodes;
-    std::map<DyckGraphEdgeLabel *, std::set<DyckGraphNode *>> OutNodes;
+    DyckGraphEdgeMap InNodes;
+    DyckGraphEdgeMap OutNodes;
+
+    /// the offsets and indices of the out-going labels, excluding the collapsed ones
+    /// @{
+    DyckFieldSummary OffsetFields;
+    DyckFieldSummary IndexFields;
+    /// @}
 
     /// only store non-null value
-    std::set<llvm::Value *> EquivClass;
+    DyckEquivalentValues EquivClass;
 
-    /// The constructor is not visible. The first argument is the pointer of the value that you want to encapsulate.
-    /// The second argument is the name of the vertex, which will be used in void DyckGraph::printAsDot() function.
-    /// please use DyckGraph::retrieveDyckVertex for initialization.
-    explicit DyckGraphNode(llvm::Value *V, const char *Name = nullptr);
+    /// the sorted view of EquivClass, which is built on demand and dropped once the class changes
+    mutable std::atomic<std::set<llvm::Value *> *> EquivSet{nullptr};
+
+    /// The constructor is not visible. The first argument is the graph that owns the vertex.
+    /// The second argument is the pointer of the value that you want to encapsulate.
+    /// The third argument is the dense index assigned by the graph.
+    /// The fourth argument is the name of the vertex, which will be used in void DyckGraph::printAsDot() function.
+    /// please use DyckGraph::retrieveDyckVertex for initialization, which allocates the vertex from the graph arena.
+    DyckGraphNode(DyckGraph *G, llvm::Value *V, int Index, const char *Name = nullptr);
 
 public:
     ~DyckGraphNode();
@@ -59,10 +287,10 @@ public:
     const char *getName();
 
     /// Get the source vertices corresponding the label
-    std::set<DyckGraphNode *> *getInVertices(DyckGraphEdgeLabel *Label);
+    DyckGraphNodeSet *getInVertices(DyckGraphEdgeLabel *Label);
 
     /// Get the target vertices corresponding the label
-    std::set<DyckGraphNode *> *getOutVertices(DyckGraphEdgeLabel *Label);
+    DyckGraphNodeSet *getOutVertices(DyckGraphEdgeLabel *Label);
 
     /// Get a single source vertex corresponding the label
     /// if there are multiple such vertices or zero, return null
@@ -81,26 +309,26 @@ public:
     /// Total degree of the vertex
     unsigned int degree();
 
-    /// Get all the labels in the edges that point to the vertex's targets.
-    std::set<DyckGraphEdgeLabel *> &getOutLabels();
-
-    /// Get all the labels in the edges that point to the vertex.
-    std::set<DyckGraphEdgeLabel *> &getInLabels();
-
     /// Get all the vertex's targets.
     /// The return value is a map which maps labels to a set of vertices.
-    std::map<DyckGraphEdgeLabel *, std::set<DyckGraphNode *>> &getOutVertices();
+    DyckGraphEdgeMap &getOutVertices();
 
     /// Get all the vertex's sources.
     /// The return value is a map which maps labels to a set of vertices.
-    std::map<DyckGraphEdgeLabel *, std::set<DyckGraphNode *>> &getInVertices();
+    DyckGraphEdgeMap &getInVertices();
 
     /// Add a target with a label. Meanwhile, this vertex will be a source of ver.
-    void addTarget(DyckGraphNode *Node, DyckGraphEdgeLabel *Label);
+    /// Return true if the edge did not exist before.
+    bool addTarget(DyckGraphNode *Node, DyckGraphEdgeLabel *Label);
 
     /// Remove a target. Meanwhile, this vertex will be removed from ver's sources
     void removeTarget(DyckGraphNode *Node, DyckGraphEdgeLabel *Label);
 
+    /// Get the summary of the offsets (or indices, if \p Ty is LT_Index) the vertex has out-going labels for.
+    const DyckFieldSummary &getFieldSummary(DyckGraphEdgeLabel::LabelType Ty) const {
+        return Ty == DyckGraphEdgeLabel::LT_Offset ? OffsetFields : IndexFields;
+    }
+
     /// Return true if the vertex contains a target ver, and the edge label is "label"
     bool containsTarget(DyckGraphNode *Tar, DyckGraphEdgeLabel *Label);
 
@@ -109,9 +337,16 @@ public:
     /// will be set to be Rep.
     void mvEquivalentSetTo(DyckGraphNode *RootRep);
 
-    /// Get the equivalent set of non-null value.
-    /// Use it after you call DyckGraph::qirunAlgorithm().
-    std::set<llvm::Value *> *getEquivalentSet();
+    /// Get the equivalent set of non-null value, which is sorted and built on the first call after the set changes.
+    /// Use it after you call DyckGraph::qirunAlgorithm(). It is safe to call it from multiple threads
+    /// as long as the graph does not change.
+    const std::set<llvm::Value *> *getEquivalentSet() const;
+
+    /// Get the non-null values of the equivalent set in no particular order, without building the sorted set.
+    const DyckEquivalentValues &getEquivalentValues() const { return EquivClass; }
+
+    /// Add a value that is in no other equivalent set, e.g., when the graph is restored from a file.
+    void addEquivalentValue(llvm::Value *V);
 
     /// the equivalent set contains null pointer
     void setContainsNull() { ContainsNull = true; }
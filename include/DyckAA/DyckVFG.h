@@ -21,13 +21,18 @@
 
 #include "DyckAA/DyckGraphNode.h"
 #include "Support/CFG.h"
-#include "Support/MapIterators.h"
+#include "llvm/ADT/iterator.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <deque>
+#include <iterator>
 #include <map>
+#include <memory>
 #include <set>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -37,50 +42,107 @@ class DyckAliasAnalysis;
 
 class DyckModRefAnalysis;
 
+class ModuleNumbering;
+
 class Call;
 
 class DyckVFGNode {
+    friend class DyckVFG;
+
+  public:
+    /// labeled edge, 0 - epsilon, pos - call, neg - return
+    using EdgeTy = std::pair<DyckVFGNode *, int>;
+
+    /// iterates a row of the compressed sparse rows of the VFG, which stores an edge as two words,
+    /// the index of the node at the other end and the label, and yields the edges by value
+    class edge_iterator {
+      private:
+        DyckVFGNode *Base;
+        const uint32_t *Ptr;
+
+        struct ArrowProxy {
+            EdgeTy E;
+            const EdgeTy *operator->() const { return &E; }
+        };
+
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = EdgeTy;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const EdgeTy *;
+        using reference = EdgeTy;
+
+        edge_iterator(DyckVFGNode *Base, const uint32_t *Ptr) : Base(Base), Ptr(Ptr) {}
+
+        EdgeTy operator*() const { return {Base + Ptr[0], (int)Ptr[1]}; }
+
+        ArrowProxy operator->() const { return {**this}; }
+
+        edge_iterator &operator++() {
+            Ptr += 2;
+            return *this;
+        }
+
+        edge_iterator operator++(int) {
+            auto Ret = *this;
+            Ptr += 2;
+            return Ret;
+        }
+
+        bool operator==(const edge_iterator &Other) const { return Ptr == Other.Ptr; }
+
+        bool operator!=(const edge_iterator &Other) const { return Ptr != Other.Ptr; }
+    };
+
   private:
     /// the value this node represents
     Value *V;
 
-    /// labeled edge, 0 - epsilon, pos - call, neg - return
+    /// the position of this node in the node array of the VFG
+    unsigned Index;
+
+    /// the ranges of out-going and incoming edges in the edge rows of the VFG,
+    /// which are empty until the VFG is frozen
     /// @{
-    using EdgeSetTy = std::set<std::pair<DyckVFGNode *, int>>;
-    EdgeSetTy Targets;
-    EdgeSetTy Sources;
+    const uint32_t *OutBegin = nullptr;
+    const uint32_t *OutEnd = nullptr;
+    const uint32_t *InBegin = nullptr;
+    const uint32_t *InEnd = nullptr;
     /// @}
 
-  public:
-    explicit DyckVFGNode(Value *V)
-        : V(V) {}
-
-    void addTarget(DyckVFGNode *N, int L = 0) {
-        assert(N);
-        this->Targets.emplace(N, L);
-        N->Sources.emplace(this, L);
+    /// the first node of the node array, which the edges refer to by index
+    DyckVFGNode *base() const {
+        return const_cast<DyckVFGNode *>(this) - Index;
     }
 
+  public:
+    DyckVFGNode(Value *V, unsigned Index)
+        : V(V), Index(Index) {}
+
     Value *getValue() const {
         return V;
     }
 
+    unsigned getIndex() const {
+        return Index;
+    }
+
     Function *getFunction() const;
 
-    EdgeSetTy::const_iterator begin() const {
-        return Targets.begin();
+    edge_iterator begin() const {
+        return {base(), OutBegin};
     }
 
-    EdgeSetTy::const_iterator end() const {
-        return Targets.end();
+    edge_iterator end() const {
+        return {base(), OutEnd};
     }
 
-    EdgeSetTy::const_iterator in_begin() const {
-        return Sources.begin();
+    edge_iterator in_begin() const {
+        return {base(), InBegin};
     }
 
-    EdgeSetTy::const_iterator in_end() const {
-        return Sources.end();
+    edge_iterator in_end() const {
+        return {base(), InEnd};
     }
 };
 
@@ -88,6 +150,30 @@ class DyckVFG {
   private:
     std::unordered_map<Value *, DyckVFGNode *> ValueNodeMap;
 
+    /// nodes are allocated in chunks while the VFG is built, and moved into a contiguous array when it is frozen
+    /// @{
+    std::deque<DyckVFGNode> NodeChunks;
+    std::vector<DyckVFGNode> Nodes;
+    /// @}
+
+    /// (source index, target index, label) of the edges added before the VFG is frozen
+    using EdgeListTy = std::vector<std::tuple<unsigned, unsigned, int>>;
+    EdgeListTy EdgeList;
+
+    /// the compressed sparse row layout of the frozen VFG, by source and by target, which each node refers to
+    /// by a range. The rows are the words of the edges as they are laid out in an exported file, so a loaded
+    /// VFG refers to the rows in the mapped file, and a built one to the words it owns.
+    /// @{
+    ArrayRef<uint32_t> OutEdges;
+    ArrayRef<uint32_t> InEdges;
+    std::vector<uint32_t> OwnedOutEdges;
+    std::vector<uint32_t> OwnedInEdges;
+    std::unique_ptr<MemoryBuffer> Buffer;
+    /// @}
+
+    /// (source, target) pairs of unlabeled edges
+    using EdgeBufferTy = std::vector<std::pair<DyckVFGNode *, DyckVFGNode *>>;
+
   public:
     DyckVFG(DyckAliasAnalysis *DAA, DyckModRefAnalysis *DMRA, Module *M);
 
@@ -95,20 +181,52 @@ class DyckVFG {
 
     DyckVFGNode *getVFGNode(Value *) const;
 
-    value_iterator<std::unordered_map<Value *, DyckVFGNode *>::iterator> node_begin() {
-        return {ValueNodeMap.begin()};
+    /// the nodes of the frozen VFG in the order of their indices, which are also in the order of their addresses
+    /// @{
+    pointer_iterator<std::vector<DyckVFGNode>::iterator> node_begin() {
+        return pointer_iterator<std::vector<DyckVFGNode>::iterator>(Nodes.begin());
     }
 
-    value_iterator<std::unordered_map<Value *, DyckVFGNode *>::iterator> node_end() {
-        return {ValueNodeMap.end()};
+    pointer_iterator<std::vector<DyckVFGNode>::iterator> node_end() {
+        return pointer_iterator<std::vector<DyckVFGNode>::iterator>(Nodes.end());
     }
+    /// @}
+
+    unsigned numNodes() const {
+        return Nodes.size();
+    }
+
+    unsigned numEdges() const {
+        return OutEdges.size() / 2;
+    }
+
+    /// Write the VFG into a versioned binary file, which refers to values by their numbers in the numbering
+    /// of the module, and stores the labeled edges as compressed sparse rows by source and by target.
+    /// Return false if the file cannot be written.
+    bool save(StringRef Path, const ModuleNumbering &Numbering) const;
+
+    /// Load a read-only VFG from a file written by save() for the same module, whose edges are used in place
+    /// in the mapped file. Return null if the file does not exist or does not match the module.
+    static DyckVFG *load(StringRef Path, const ModuleNumbering &Numbering);
 
   private:
+    DyckVFG() = default;
+
     DyckVFGNode *getOrCreateVFGNode(Value *);
 
+    void addEdge(DyckVFGNode *From, DyckVFGNode *To, int L = 0) {
+        assert(From && To && Nodes.empty() && "the VFG has been frozen");
+        EdgeList.emplace_back(From->Index, To->Index, L);
+    }
+
+    /// move the nodes into a contiguous array, and the deduplicated edges into compressed sparse rows
+    void freeze();
+
     void connect(DyckAliasAnalysis *DAA, DyckModRefAnalysis *, Call *, Function *, CFG *);
 
-    void buildLocalVFG(DyckAliasAnalysis *DAA, CFG *DMRA, Function *F) const;
+    /// compute the indirect value flow of a function into a buffer, which does not change the VFG,
+    /// so that it can run in parallel for different functions
+    void buildLocalVFG(DyckAliasAnalysis *DAA, CFG *DMRA, Function *F, EdgeBufferTy &Edges) const;
     void connectInsertExtractIndirectFlow(std::map<DyckGraphNode *, std::vector<ExtractValueInst *>>,
                                           std::map<DyckGraphNode *, std::vector<InsertValueInst *>>,
                                           std::function<bool(Instruction *, Instruction *)> Reachable,
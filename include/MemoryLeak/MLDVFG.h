@@ -71,8 +71,27 @@ class MLDVFG {
     DyckAliasAnalysis *DyckAA;
     std::map<DyckVFGNode *, Slice> LeakMap;
     std::set<DyckVFGNode *> SourcesSet;
+
+    /// (entry, call id) -> the nodes reached by entering a callee from a call edge to the entry with the call id,
+    /// and returning to the same call site, which is computed once and shared by the slices of all sources
+    std::map<std::pair<DyckVFGNode *, int>, std::vector<DyckVFGNode *>> Summaries;
+    bool SummariesComputed = false;
+    void computeSummaries();
+
     void ForwardReachable(DyckVFGNode *);
+    /// context-sensitive forward reachability using the function summaries
+    void ForwardReachableWithSummaries(DyckVFGNode *);
+    /// context-sensitive forward reachability using call strings with at most K calls
+    void ForwardReachableWithContexts(DyckVFGNode *, unsigned K);
     void BackwardReachable(DyckVFGNode *);
+
+    /// compute the slices of the sources, which are forward reachable if Backward is false,
+    /// or also backward reachable from the sinks otherwise
+    void computeSlices(const std::vector<DyckVFGNode *> &Sources, bool Backward);
+    /// compute the slices of a batch of sources at once by propagating bit vectors of sources
+    void computeSliceBatch(const std::vector<DyckVFGNode *> &Sources, bool Backward);
+    /// index -> node
+    std::vector<DyckVFGNode *> IndexedNodes;
     // void dyckForwardReachable(DyckVFGNode *);
 
     struct Context {
@@ -9,6 +9,7 @@
 #include "MemoryLeak/MLDReport.h"
 #include "MemoryLeak/MLDVFG.h"
 #include "Support/CFG.h"
+#include "Support/ThreadPool.h"
 #include "z3++.h"
 #include "llvm/Analysis/PostDominators.h"
 #include "llvm/IR/Argument.h"
@@ -19,6 +20,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include <cassert>
 #include <cstddef>
+#include <atomic>
 #include <map>
 #include <utility>
 
@@ -29,51 +31,62 @@ using z3::solver;
 class VFGReachable {
     using BrCondMapTy = std::map<llvm::BasicBlock *, std::vector<expr>>;
     using FuncDomTreeMapTy = std::map<llvm::Function *, PostDominatorTree>;
-    context GlobalContext;
-    solver GlobalSolver;
-    BrCondMapTy BranchBBCond;
+
+    /// z3 contexts are not thread-safe, so each thread solves slices in its own context,
+    /// with the branch conditions and intermediate results built in it
+    struct SolverLocal {
+        context Ctx;
+        /// the incremental solver reused by all queries of this thread, each of which is pushed and popped
+        solver IncSolver;
+        BrCondMapTy BranchBBCond;
+        /// dst -> (src -> the condition from src to dst), for the blocks of the function of dst reaching it
+        std::map<llvm::BasicBlock *, std::map<llvm::BasicBlock *, expr>> IntraCondCache;
+        Slice *CurrSlice = nullptr;
+
+        SolverLocal()
+            : IncSolver(Ctx) {}
+    };
+
     FuncDomTreeMapTy FuncDomTree;
     MLDVFG *MVFG;
     DyckVFG *DVFG;
     DyckAliasAnalysis *DAA;
-    std::map<llvm::BasicBlock *, expr> BBCond;
-    std::map<DyckVFGNode *, expr> VFGNodeCond;
-    Slice *CurrSlice;
+
+    /// the id of the branch variable of a basic block with multiple successors,
+    /// shared by all threads so that a branch has the same variable in every context
+    std::map<llvm::BasicBlock *, int> BranchID;
 
     std::map<llvm::Function *, CFGRef> CFGMap;
 
-    void computerIntraCond(BasicBlock *src, BasicBlock *dst, std::vector<int> visited, std::vector<std::pair<BasicBlock *, int>> pathCond);
-    expr computerIntraCond(BasicBlock *src, BasicBlock *dst);
-    expr computerCallCond(BasicBlock *src, BasicBlock *dst, const Call *CallSite);
-    expr computerRetCond(BasicBlock *src, BasicBlock *dst, const Call *CallSite);
+    /// statistics of the queries sent to z3 and those decided syntactically
+    /// @{
+    std::atomic<unsigned> NumSolverCalls{0};
+    std::atomic<unsigned> NumSolverCallsAvoided{0};
+    std::atomic<unsigned> NumIntraCondQueries{0};
+    std::atomic<unsigned> NumIntraCondComputed{0};
+    /// @}
 
-    void addBBID(BasicBlock *bb);
+    /// check the formula in a new scope of the incremental solver of this thread
+    z3::check_result check(const expr &Formula);
 
-    inline bool updateBBCond(BasicBlock *BB, expr NewCond) {
-        if (BBCond.find(BB) == BBCond.end()) {
-            BBCond.insert(std::make_pair(BB, NewCond));
-            return true;
-        }
-        BBCond.insert(std::make_pair(BB, NewCond || BBCond.at(BB)));
-        return true;
-        // GlobalSolver.push();
-        // GlobalSolver.add(NewCond == BBCond.at(BB));
-        // z3::check_result res = GlobalSolver.check();
-        // GlobalSolver.pop();
-        // if (res == z3::sat) {
-        //     return false;
-        // }
-        // else {
-            
-        // }
+    inline SolverLocal &local() const {
+        return *ThreadPool::get()->getThreadLocal<SolverLocal>();
     }
 
+    /// the conditions of the out-going edges of a basic block in the context of this thread
+    const std::vector<expr> &getBranchConds(BasicBlock *BB);
+
+    expr computerIntraCond(BasicBlock *src, BasicBlock *dst);
+    const std::map<BasicBlock *, expr> &getIntraConds(BasicBlock *dst);
+    expr computerCallCond(BasicBlock *src, BasicBlock *dst, const Call *CallSite);
+    expr computerRetCond(BasicBlock *src, BasicBlock *dst, const Call *CallSite);
+
     inline expr getTrueCond() {
-        return GlobalContext.bool_val(true);
+        return local().Ctx.bool_val(true);
     }
 
     inline expr getFalseCond() {
-        return GlobalContext.bool_val(false);
+        return local().Ctx.bool_val(false);
     }
     inline bool reachable(BasicBlock *b1, BasicBlock *b2) {
         // assert(b1->getParent() == b2->getParent() && "The two basic block should be in the same function");
@@ -20,7 +20,9 @@
 #define SUPPORT_API_H
 
 #include "llvm/IR/Argument.h"
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/IR/Instruction.h>
+#include <llvm/IR/Module.h>
 #include <set>
 #include <map>
 using namespace llvm;
@@ -34,8 +36,31 @@ public:
     static bool isStackAllocate(Instruction *);
 
     static bool isRustSinkForC(Argument *);
+
+    /// Classify the functions of a module once, demangling each of them in parallel, so that the predicates
+    /// above look up the roles of a function by its pointer instead of by its name.
+    /// A function out of the table, e.g., one created afterwards, is still classified by its name.
+    /// The table is read by concurrent analyses, so it is only built when none of them is running.
+    static void classifyFunctions(Module *M);
+
+    /// add an allocator by its name, and update the role of the function of the name in the table
+    static void addHeapAllocFunction(StringRef Name);
+
     static std::set<std::string> HeapAllocFunctions;
     static std::map<std::string, int> RustSinkFunctionsForC;
+
+private:
+    struct FunctionRoles {
+        bool HeapAlloc = false;
+        /// the index of the argument that a sink for c releases, or -1 if the function is not a sink
+        int SinkArg = -1;
+    };
+
+    static FunctionRoles classify(const Function *);
+
+    static DenseMap<const Function *, FunctionRoles> Roles;
+
+    static Module *ClassifiedModule;
 };
 
 #endif //SUPPORT_API_H
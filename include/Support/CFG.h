@@ -19,38 +19,65 @@
 #ifndef SUPPORT_CFG_H
 #define SUPPORT_CFG_H
 
-#include <bitset>
 #include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Instruction.h>
+#include <memory>
 #include <vector>
-#include <map>
 
 using namespace llvm;
 
+/// The reachability index of a function's control flow graph.
+/// Blocks are condensed into strongly connected components, and the sccs are numbered in the post order of
+/// a spanning forest of the condensation DAG. Each scc is labeled with the intervals of the numbers of the sccs
+/// it reaches, i.e., the interval of its subtree merged with the intervals of its successors, so that a query
+/// is a binary search and never traverses the graph. The labels are small as control flow graphs are almost
+/// trees. The index is immutable after construction and can be queried concurrently.
 class CFG {
 private:
-    typedef BitVector ReachableVec;
-    ReachableVec AnalyzedVec;
-    ReachableVec *ReachableVecPtr;
+    /// block -> the id of its scc, where an scc is numbered after the sccs it reaches
+    DenseMap<const BasicBlock *, unsigned> BB2SCC;
 
-    /// ID mapping
-    std::vector<BasicBlock *> ID2BB;
-    std::map<BasicBlock *, int> BB2ID;
+    /// the blocks ordered by the ids of their sccs
+    std::vector<BasicBlock *> SCCOrder;
+
+    /// whether an scc contains a cycle, i.e., it has multiple blocks or a self loop
+    BitVector CyclicSCC;
+
+    /// scc -> its number in the post order of the spanning forest
+    std::vector<unsigned> PostOrder;
+
+    /// the sorted disjoint intervals [first, second] of the post order numbers of the sccs reachable from
+    /// each scc, where the intervals of scc K are [IntervalStart[K], IntervalStart[K + 1])
+    /// @{
+    std::vector<std::pair<unsigned, unsigned>> Intervals;
+    std::vector<unsigned> IntervalStart;
+    /// @}
 
 public:
     explicit CFG(Function *);
 
     ~CFG();
 
-    bool reachable(BasicBlock *, BasicBlock *);
+    bool reachable(BasicBlock *, BasicBlock *) const;
 
-    bool reachable(Instruction *, Instruction *);
+    bool reachable(Instruction *, Instruction *) const;
 
-private:
-    void analyze(BasicBlock *);
-};
+    unsigned getSCC(const BasicBlock *BB) const {
+        assert(BB2SCC.count(BB));
+        return BB2SCC.lookup(BB);
+    }
+
+    bool inCycle(const BasicBlock *BB) const {
+        return CyclicSCC[getSCC(BB)];
+    }
 
+    /// the blocks in the order of their sccs, so that a block comes after all blocks it reaches but not reached by
+    const std::vector<BasicBlock *> &sccOrder() const {
+        return SCCOrder;
+    }
+};
 typedef std::shared_ptr<CFG> CFGRef;
 
 #endif //SUPPORT_CFG_H
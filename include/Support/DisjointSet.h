@@ -20,7 +20,9 @@
 #ifndef SUPPORT_DISJOINTSET_H
 #define SUPPORT_DISJOINTSET_H
 
+#include <cassert>
 #include <unordered_map>
+#include <vector>
 
 template<typename T>
 struct Node {
@@ -92,4 +94,54 @@ public:
     }
 };
 
+/// A disjoint set over dense indices 0, 1, 2, ..., with path halving.
+/// Unlike DisjointSet, the caller decides which root survives a union,
+/// so that the root can be the element holding the merged data.
+class IndexDisjointSet {
+private:
+    std::vector<unsigned> _parent;
+
+public:
+    IndexDisjointSet() = default;
+
+    /// create the singleton set of the next index, and return the index
+    unsigned makeSet() {
+        _parent.push_back(_parent.size());
+        return _parent.size() - 1;
+    }
+
+    /// paths are only written if they change, so that lookups in a flattened set do not write
+    unsigned findSet(unsigned idx) {
+        while (_parent[idx] != idx) {
+            unsigned grandparent = _parent[_parent[idx]];
+            if (_parent[idx] != grandparent) _parent[idx] = grandparent;
+            idx = grandparent;
+        }
+        return idx;
+    }
+
+    /// point every index directly to its root, after which findSet is read-only and can be called concurrently
+    void flatten() {
+        for (unsigned idx = 0; idx < _parent.size(); ++idx) _parent[idx] = findSet(idx);
+        assert(isFlat());
+    }
+
+    /// return true if every element points at its root, so that findSet does not write
+    bool isFlat() const {
+        for (unsigned idx = 0; idx < _parent.size(); ++idx)
+            if (_parent[_parent[idx]] != _parent[idx]) return false;
+        return true;
+    }
+
+    /// make the set rooted at child a part of the set rooted at root
+    void link(unsigned root, unsigned child) {
+        assert(_parent[root] == root && _parent[child] == child);
+        _parent[child] = root;
+    }
+
+    size_t size() const {
+        return _parent.size();
+    }
+};
+
 #endif //SUPPORT_DISJOINTSET_H
@@ -21,21 +21,64 @@
 
 #include <llvm/Support/ManagedStatic.h>
 
+#include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <future>
 #include <map>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <vector>
 
 #include "Support/MapIterators.h"
 
 class ThreadPool {
+public:
+    /// a group of tasks that can be waited for without waiting for other tasks in the pool
+    class TaskGroup {
+        friend class ThreadPool;
+
+        std::mutex Mutex;
+        std::condition_variable Done;
+        unsigned NumPending = 0;
+
+    public:
+        TaskGroup() = default;
+
+        TaskGroup(const TaskGroup &) = delete;
+
+        TaskGroup &operator=(const TaskGroup &) = delete;
+    };
+
 private:
     ThreadPool();
 
+    /// the tasks of a worker, which pops from the back and is stolen from the front
+    struct WorkerQueue {
+        std::mutex Mutex;
+        std::deque<std::function<void()>> Tasks;
+    };
+
+    /// push a task to the queue of the current worker, or to the queues in turn if the caller is not a worker
+    void push(std::function<void()> Task);
+
+    /// pop a task from the queue of the worker, or steal one from the others
+    bool pop(unsigned WorkerID, std::function<void()> &Task);
+
+    /// the main loop of a worker
+    void run(unsigned WorkerID);
+
+    template<class F, class... Args>
+    auto enqueueIn(TaskGroup *, F &&, Args &&...) -> std::future<typename std::result_of<F(Args...)>::type>;
+
+    /// count a new task in the pool and in the group, if any
+    void start(TaskGroup *Group);
+
+    /// count a task done, and wake up the threads waiting for the pool or the group
+    void finish(TaskGroup *Group);
+
 public:
     ~ThreadPool();
 
@@ -43,9 +86,25 @@ public:
     template<class F, class... Args>
     auto enqueue(F &&, Args &&...) -> std::future<typename std::result_of<F(Args...)>::type>;
 
+    /// add new work item to the pool as a member of the group
+    template<class F, class... Args>
+    auto enqueue(TaskGroup &, F &&, Args &&...) -> std::future<typename std::result_of<F(Args...)>::type>;
+
     /// Wait until no tasks remain
     void wait();
 
+    /// Wait until no tasks of the group remain, running queued tasks meanwhile if called from a worker
+    void wait(TaskGroup &);
+
+    /// the number of tasks a worker took from the queue of another worker
+    uint64_t numSteals() const {
+        return NumSteals;
+    }
+
+    /// the total time in milliseconds the workers spent waiting for tasks
+    uint64_t idleMilliseconds() const {
+        return IdleMicroseconds / 1000;
+    }
     /// each thread is allowed to deaclare a thread local
     /// if you want to decalre more, you can pack them into a struct
     /// you need manually call deinitThreadLocal to delete the
@@ -54,7 +113,7 @@ public:
     void initThreadLocal() {
         // Add main thread id
         auto Id = std::this_thread::get_id();
-        if (ThreadLocals.find(Id) == ThreadLocals.end()) {
+        if (!ThreadLocals[Id]) {
             ThreadLocals[Id] = new LocalTy;
         }
 
@@ -95,15 +154,28 @@ public:
     /// workers of the thread pool
     std::vector<std::thread> Workers;
 
-    /// the task queue containing tasks
-    std::queue<std::function<void()>> TaskQueue;
+    /// the task queues, one per worker
+    std::vector<std::unique_ptr<WorkerQueue>> Queues;
 
-    std::mutex QueueMutex;             ///< The lock
-    std::condition_variable Condition; ///< the wait cond
+    /// the worker a non-worker thread pushes its next task to
+    std::atomic<unsigned> NextQueue;
+
+    /// the number of tasks in all queues, which is increased while holding SleepMutex before a task is published
+    std::atomic<unsigned> NumQueued;
+
+    std::mutex SleepMutex;                 ///< The lock for idle workers
+    std::condition_variable WorkAvailable; ///< the cond idle workers wait for
 
     bool IsStop; ///< identifying if the thread pool is running
 
-    int NumRunningTask; /// < number of running task
+    /// all tasks in the pool, which wait() waits for
+    TaskGroup AllTasks;
+
+    /// statistics
+    /// @{
+    std::atomic<uint64_t> NumSteals;
+    std::atomic<uint64_t> IdleMicroseconds;
+    /// @}
 
     std::map<std::thread::id, void *> ThreadLocals;
 
@@ -114,6 +186,18 @@ public:
 
 template<class F, class... Args>
 auto ThreadPool::enqueue(F &&Func, Args &&... Arguments) -> std::future<typename std::result_of<F(Args...)>::type> {
+    return enqueueIn(nullptr, std::forward<F>(Func), std::forward<Args>(Arguments)...);
+}
+
+template<class F, class... Args>
+auto ThreadPool::enqueue(TaskGroup &Group, F &&Func, Args &&... Arguments)
+        -> std::future<typename std::result_of<F(Args...)>::type> {
+    return enqueueIn(&Group, std::forward<F>(Func), std::forward<Args>(Arguments)...);
+}
+
+template<class F, class... Args>
+auto ThreadPool::enqueueIn(TaskGroup *Group, F &&Func, Args &&... Arguments)
+        -> std::future<typename std::result_of<F(Args...)>::type> {
     using return_type = typename std::result_of<F(Args...)>::type; // The return type
 
     auto Task = std::make_shared<std::packaged_task<return_type()>>(
@@ -125,16 +209,15 @@ auto ThreadPool::enqueue(F &&Func, Args &&... Arguments) -> std::future<typename
         return Res;
     }
 
-    {
-        std::unique_lock<std::mutex> Lock(QueueMutex); // acquiring lock
-
-        // don't allow to enqueue after stopping the pool
-        if (IsStop)
-            llvm_unreachable("enqueue on stopped ThreadPool");
+    // don't allow to enqueue after stopping the pool
+    if (IsStop)
+        llvm_unreachable("enqueue on stopped ThreadPool");
 
-        TaskQueue.emplace([Task]() { (*Task)(); });
-    }
-    Condition.notify_one();
+    start(Group);
+    push([this, Task, Group]() {
+        (*Task)();
+        finish(Group);
+    });
     return Res;
 }
 
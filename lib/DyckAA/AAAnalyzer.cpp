@@ -19,11 +19,16 @@
  #include <cstddef>
 #include <cassert>
 #include <ctime>
+#include <atomic>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/EquivalenceClasses.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/IR/GetElementPtrTypeIterator.h>
 #include <llvm/IR/InstIterator.h>
 #include "AAAnalyzer.h"
 #include "DyckAA/DyckGraphNode.h"
 #include "Support/RecursiveTimer.h"
+#include "Support/ThreadPool.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
@@ -43,6 +48,24 @@ static cl::opt<bool> WithFunctionCastComb("with-function-cast-comb", cl::init(fa
 static cl::opt<bool> PrintUnknownPointerCall("print-unknown-ptr-call", cl::init(false), cl::Hidden,
                                              cl::desc("print unknown ptr call"));
 
+static cl::opt<bool> IncrementalPointerCalls("dyckaa-incremental-ptr-calls", cl::init(true), cl::Hidden,
+                                             cl::desc("Only revisit a pointer call if the alias set of "
+                                                      "its called value has grown."));
+
+static cl::opt<bool> ValueSubstitution("dyckaa-value-substitution", cl::init(true), cl::Hidden,
+                                       cl::desc("Let a cast, phi, select or zero-offset gep share the vertex of a "
+                                                "value it is copied from, instead of creating and merging its own."));
+
+static cl::opt<unsigned> MaxFields("dyckaa-max-fields", cl::init(256), cl::Hidden,
+                                   cl::desc("Collapse the offset (or index) edges of a vertex into one edge once it "
+                                            "has more distinct offsets (or indices) than this, 0 for no limit."));
+
+static cl::opt<unsigned> FieldStride("dyckaa-field-stride", cl::init(0), cl::Hidden,
+                                     cl::desc("Collapse the offset (or index) edges of a vertex into one edge once "
+                                              "this many of them are evenly spaced without gaps, which is typical of "
+                                              "an array accessed with constant indices but may also be a struct "
+                                              "of same-sized fields. 0 to disable, the default."));
+
 static cl::opt<unsigned> NumInterIteration("dyckaa-inter-iteration", cl::init(UINT_MAX), cl::Hidden,
                                            cl::desc("The max # iterators for fixed-point inter-proc computation."));
 
@@ -54,33 +77,276 @@ AAAnalyzer::AAAnalyzer(Module *M, DyckGraph *DG, DyckCallGraph *CG) {
     CFLGraph = DG;
     DyckCG = CG;
     DL = &M->getDataLayout();
+    IntraResult = nullptr;
+    CFLGraph->setFieldLimits(MaxFields, FieldStride);
     initFunctionGroups();
 }
 
+AAAnalyzer::AAAnalyzer(Module *M, DyckCallGraph *CG, IntraProcedureResult *R) {
+    Mod = M;
+    CFLGraph = &R->Graph;
+    DyckCG = CG;
+    DL = &M->getDataLayout();
+    IntraResult = R;
+    CFLGraph->setFieldLimits(MaxFields, FieldStride);
+}
+
 AAAnalyzer::~AAAnalyzer() {
     destroyFunctionGroups();
 }
 
+std::string AAAnalyzer::getConfiguration() {
+    return "function-type-check-level=" + std::to_string(FunctionTypeCheckLevel.getValue()) +
+           ";with-function-cast-comb=" + std::to_string(WithFunctionCastComb.getValue()) +
+           ";dyckaa-max-fields=" + std::to_string(MaxFields.getValue()) +
+           ";dyckaa-field-stride=" + std::to_string(FieldStride.getValue()) +
+           ";dyckaa-inter-iteration=" + std::to_string(NumInterIteration.getValue());
+}
+
 void AAAnalyzer::intraProcedureAnalysis() {
     RecursiveTimer IntraAA("Running intra-procedural analysis");
     long InstNum = 0;
     long IntrinsicsNum = 0;
+    std::vector<Function *> Funcs;
     for (auto &F: *Mod) {
         if (F.isIntrinsic()) {
             // intrinsics are handled as instructions
             IntrinsicsNum++;
             continue;
         }
-        DyckCallGraphNode *DF = DyckCG->getOrInsertFunction(&F);
-        for (auto &I: instructions(F)) {
-            InstNum++;
-            handleInst(&I, DF);
-        }
+        // all call graph nodes are created here, so that workers only look them up
+        DyckCG->getOrInsertFunction(&F);
+        Funcs.push_back(&F);
+        InstNum += F.getInstructionCount();
     }
+    analyzeFunctions(Funcs);
     DEBUG_WITH_TYPE("dyckaa-stats", errs() << "\n# Instructions: " << InstNum << "\n");
     DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Functions: " << Mod->size() - IntrinsicsNum << "\n");
 }
 
+void AAAnalyzer::intraProcedureAnalysis(const std::vector<Function *> &Funcs) {
+    RecursiveTimer IntraAA("Running intra-procedural analysis incrementally");
+    std::set<Function *> Defined(Funcs.begin(), Funcs.end());
+    for (auto *CGNode: make_range(DyckCG->nodes_begin(), DyckCG->nodes_end())) {
+        for (auto It = CGNode->pointer_call_begin(), E = CGNode->pointer_call_end(); It != E; ++It) {
+            auto *PCall = *It;
+            // the restored callees have been handled with the restored alias set
+            auto &EquivSet = CFLGraph->retrieveDyckVertex(PCall->getCalledValue()).first->getEquivalentValues();
+            HandledAliasSetSizes[PCall] = EquivSet.size();
+            // a restored callee that was a declaration has not been matched with the call yet,
+            // and the direct calls to it are matched again by the inter-procedural analysis
+            for (auto *Callee: *PCall) {
+                if (Defined.count(Callee))
+                    handleCommonFunctionCall(PCall, CGNode, DyckCG->getOrInsertFunction(Callee));
+            }
+        }
+    }
+    analyzeFunctions(Funcs);
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "\n# Functions re-analyzed: " << Funcs.size() << "\n");
+}
+
+void AAAnalyzer::analyzeFunctions(const std::vector<Function *> &Funcs) {
+    std::atomic<unsigned> NumSubstitutes(0);
+    if (ThreadPool::get()->Workers.empty()) {
+        for (auto *F: Funcs) {
+            DyckCallGraphNode *DF = DyckCG->getOrInsertFunction(F);
+            NumSubstitutes += computeSubstitutes(F);
+            for (auto &I: instructions(F)) {
+                handleInst(&I, DF);
+            }
+        }
+        Substitutes.clear();
+    } else {
+        // each function is analyzed into its own graph, and the graphs are merged in the order of functions
+        std::vector<IntraProcedureResult *> Results(Funcs.size(), nullptr);
+        ThreadPool::TaskGroup Group;
+        for (unsigned K = 0; K < Funcs.size(); ++K) {
+            if (Funcs[K]->empty()) continue;
+            Results[K] = new IntraProcedureResult;
+            ThreadPool::get()->enqueue(Group, [this, &Funcs, &Results, &NumSubstitutes, K]() {
+                AAAnalyzer LocalAA(Mod, DyckCG, Results[K]);
+                DyckCallGraphNode *DF = DyckCG->getOrInsertFunction(Funcs[K]);
+                NumSubstitutes += LocalAA.computeSubstitutes(Funcs[K]);
+                for (auto &I: instructions(Funcs[K])) {
+                    LocalAA.handleInst(&I, DF);
+                }
+            });
+        }
+        ThreadPool::get()->wait(Group);
+
+        for (auto *R: Results) {
+            if (!R) continue;
+            mergeIntraProcedureResult(R);
+            delete R;
+        }
+    }
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Values substituted: " << NumSubstitutes << "\n");
+}
+
+/// Get the operands that handleInst unifies \p I with, provided that \p I ends up in the same vertex as them.
+/// A gep is such a copy only if handleGEP returns the vertex of its pointer, i.e., no index moves the pointer.
+static void getCopiedOperands(Instruction *I, const DataLayout &DL, SmallVectorImpl<Value *> &Ops) {
+    switch (I->getOpcode()) {
+        case Instruction::AddrSpaceCast:
+        case Instruction::Trunc:
+        case Instruction::ZExt:
+        case Instruction::SExt:
+        case Instruction::FPTrunc:
+        case Instruction::FPExt:
+        case Instruction::FPToUI:
+        case Instruction::FPToSI:
+        case Instruction::UIToFP:
+        case Instruction::SIToFP:
+        case Instruction::BitCast:
+        case Instruction::PtrToInt:
+        case Instruction::IntToPtr:
+            Ops.push_back(I->getOperand(0));
+            break;
+        case Instruction::PHI:
+            for (Value *Incoming: cast<PHINode>(I)->incoming_values()) Ops.push_back(Incoming);
+            break;
+        case Instruction::Select:
+            Ops.push_back(cast<SelectInst>(I)->getTrueValue());
+            Ops.push_back(cast<SelectInst>(I)->getFalseValue());
+            break;
+        case Instruction::GetElementPtr: {
+            auto *GEP = cast<GetElementPtrInst>(I);
+            auto GTI = gep_type_begin(GEP);
+            Type *AggOrPointerTy = GEP->getPointerOperandType();
+            for (unsigned K = 1; K < GEP->getNumOperands(); ++K, ++GTI) {
+                auto *CI = dyn_cast<ConstantInt>(GEP->getOperand(K));
+                if (auto *STy = dyn_cast<StructType>(AggOrPointerTy)) {
+                    if (!CI || DL.getStructLayout(STy)->getElementOffset(CI->getZExtValue()) != 0) return;
+                } else if (AggOrPointerTy->isArrayTy() || AggOrPointerTy->isPointerTy()) {
+                    if (CI && !CI->isZero()) return;
+                } else if (!AggOrPointerTy->isVectorTy()) {
+                    return;
+                }
+                AggOrPointerTy = GTI.getIndexedType();
+            }
+            Ops.push_back(GEP->getPointerOperand());
+        }
+            break;
+        default:
+            break;
+    }
+}
+
+unsigned AAAnalyzer::computeSubstitutes(Function *F) {
+    Substitutes.clear();
+    if (!ValueSubstitution) return 0;
+
+    // the classes of values that are unified by copies alone
+    EquivalenceClasses<Value *> Copies;
+    std::vector<Instruction *> CopyInsts;
+    SmallVector<Value *, 4> Ops;
+    for (auto &I: instructions(F)) {
+        Ops.clear();
+        getCopiedOperands(&I, *DL, Ops);
+        if (Ops.empty()) continue;
+        CopyInsts.push_back(&I);
+        for (auto *Op: Ops) Copies.unionSets(&I, Op);
+    }
+
+    // a class shares the vertex of the first value in it that is not a copy, which is wrapped as usual;
+    // a class of copies only, e.g., a cycle of phis, is left as it is
+    DenseSet<Value *> IsCopy(CopyInsts.begin(), CopyInsts.end());
+    DenseMap<Value *, Value *> Roots;
+    for (auto *I: CopyInsts) {
+        Ops.clear();
+        getCopiedOperands(I, *DL, Ops);
+        for (auto *Op: Ops) {
+            if (!IsCopy.count(Op)) Roots.try_emplace(Copies.getLeaderValue(Op), Op);
+        }
+    }
+    for (auto *I: CopyInsts) {
+        auto It = Roots.find(Copies.getLeaderValue(I));
+        if (It != Roots.end()) Substitutes[I] = It->second;
+    }
+    return Substitutes.size();
+}
+
+void AAAnalyzer::mergeIntraProcedureResult(IntraProcedureResult *R) {
+    // the initializers of globals are handled once in the shared graph
+    for (auto *G: R->Globals) wrapValue(G);
+
+    // map each local vertex to a shared vertex, which is identified by one of its values,
+    // or by its index if it has no value, because the former may be merged into another vertex
+    std::unordered_map<DyckGraphNode *, std::pair<Value *, unsigned>> LocalToShared;
+    for (auto *LocalNode: R->Graph.getVertices()) {
+        auto &Vals = LocalNode->getEquivalentValues();
+        if (Vals.empty()) {
+            auto *SharedNode = CFLGraph->retrieveDyckVertex(nullptr).first;
+            LocalToShared[LocalNode] = std::make_pair(nullptr, SharedNode->getIndex());
+            continue;
+        }
+        auto ValIt = Vals.begin();
+        auto *SharedNode = CFLGraph->retrieveDyckVertex(*ValIt).first;
+        LocalToShared[LocalNode] = std::make_pair(*ValIt, 0);
+        while (++ValIt != Vals.end()) {
+            SharedNode = makeAlias(SharedNode, CFLGraph->retrieveDyckVertex(*ValIt).first);
+        }
+    }
+    auto GetSharedNode = [this, &LocalToShared](DyckGraphNode *LocalNode) {
+        auto &Key = LocalToShared.at(LocalNode);
+        return Key.first ? CFLGraph->findDyckVertex(Key.first) : CFLGraph->getVertex(Key.second);
+    };
+
+    for (auto *LocalNode: R->Graph.getVertices()) {
+        auto *Src = GetSharedNode(LocalNode);
+        for (auto &LocalOut: LocalNode->getOutVertices()) {
+            DyckGraphEdgeLabel *Label = LocalOut.first;
+            // the fields of the shared vertex are collapsed by the same policy as the local ones
+            if (Label->isLabelTy(DyckGraphEdgeLabel::LT_Offset)) {
+                Label = CFLGraph->getOrInsertFieldEdgeLabel(Src, DyckGraphEdgeLabel::LT_Offset,
+                                                            ((PointerOffsetEdgeLabel *) Label)->getOffsetBytes());
+            } else if (Label->isLabelTy(DyckGraphEdgeLabel::LT_Index)) {
+                Label = CFLGraph->getOrInsertFieldEdgeLabel(Src, DyckGraphEdgeLabel::LT_Index,
+                                                            ((FieldIndexEdgeLabel *) Label)->getFieldIndex());
+            } else {
+                assert(Label->isLabelTy(DyckGraphEdgeLabel::LT_Dereference));
+                Label = CFLGraph->getDereferenceEdgeLabel();
+            }
+            for (auto *LocalTarget: LocalOut.second) {
+                Src->addTarget(GetSharedNode(LocalTarget), Label);
+            }
+        }
+    }
+
+    for (auto &Record: R->Calls) {
+        switch (Record.Kind) {
+            case IntraProcedureResult::CallRecord::CRK_Common:
+                Record.Parent->addCommonCall(
+                        DyckCG->createCommonCall(Record.Inst, (Function *) Record.CalledValue, &Record.Args));
+                break;
+            case IntraProcedureResult::CallRecord::CRK_Pointer:
+                Record.Parent->addPointerCall(DyckCG->createPointerCall(Record.Inst, Record.CalledValue, &Record.Args));
+                break;
+            case IntraProcedureResult::CallRecord::CRK_Thread:
+                handleInvokeCallInst(nullptr, Record.CalledValue, &Record.Args, Record.Parent);
+                break;
+        }
+    }
+}
+
+void AAAnalyzer::addCommonCall(DyckCallGraphNode *Parent, Instruction *Inst, Function *Callee,
+                               std::vector<Value *> *Args) {
+    if (IntraResult) {
+        IntraResult->Calls.push_back({IntraProcedureResult::CallRecord::CRK_Common, Parent, Inst, Callee, *Args});
+    } else {
+        Parent->addCommonCall(DyckCG->createCommonCall(Inst, Callee, Args));
+    }
+}
+
+void AAAnalyzer::addPointerCall(DyckCallGraphNode *Parent, Instruction *Inst, Value *CalledValue,
+                                std::vector<Value *> *Args) {
+    if (IntraResult) {
+        IntraResult->Calls.push_back({IntraProcedureResult::CallRecord::CRK_Pointer, Parent, Inst, CalledValue, *Args});
+    } else {
+        Parent->addPointerCall(DyckCG->createPointerCall(Inst, CalledValue, Args));
+    }
+}
+
 void AAAnalyzer::interProcedureAnalysis() {
     RecursiveTimer IntraAA("Running inter-procedural analysis");
 
@@ -128,6 +394,10 @@ void AAAnalyzer::interProcedureAnalysis() {
 
         if (Finished) break;
     }
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Worklist pushes: " << CFLGraph->numWorklistPushes() << "\n");
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Worklist pops: " << CFLGraph->numWorklistPops() << "\n");
+    DEBUG_WITH_TYPE("dyckaa-stats",
+                    errs() << "# Vertices with collapsed fields: " << CFLGraph->numCollapsedVertices() << "\n");
 
     // finalize the call graph
     for (auto &F: *Mod) {
@@ -316,16 +586,17 @@ void AAAnalyzer::combineFunctionGroups(FunctionType *FTyX, FunctionType *FTyY) {
 }
 
 DyckGraphNode *AAAnalyzer::addField(DyckGraphNode *Val, long FieldIndex, DyckGraphNode *Field) {
+    auto *Label = CFLGraph->getOrInsertFieldEdgeLabel(Val, DyckGraphEdgeLabel::LT_Index, FieldIndex);
     if (!Field) {
-        auto *ValRepSet = Val->getOutVertices((CFLGraph->getOrInsertIndexEdgeLabel(FieldIndex)));
+        auto *ValRepSet = Val->getOutVertices(Label);
         if (ValRepSet && !ValRepSet->empty()) {
             Field = *(ValRepSet->begin());
         } else {
             Field = CFLGraph->retrieveDyckVertex(nullptr).first;
-            Val->addTarget(Field, (CFLGraph->getOrInsertIndexEdgeLabel(FieldIndex)));
+            Val->addTarget(Field, Label);
         }
     } else {
-        Val->addTarget(Field, (CFLGraph->getOrInsertIndexEdgeLabel(FieldIndex)));
+        Val->addTarget(Field, Label);
     }
     return Field;
 }
@@ -341,7 +612,7 @@ DyckGraphNode *AAAnalyzer::addPtrTo(DyckGraphNode *Address, DyckGraphNode *Val)
         Address->addTarget(Val, DLabel);
         return Address;
     } else if (!Val) {
-        std::set<DyckGraphNode *> *DerefSet = Address->getOutVertices(DLabel);
+        DyckGraphNodeSet *DerefSet = Address->getOutVertices(DLabel);
         if (DerefSet && !DerefSet->empty()) {
             Val = *(DerefSet->begin());
         } else {
@@ -400,7 +671,8 @@ DyckGraphNode *AAAnalyzer::handleGEP(GEPOperator *GEP) {
 
             if(offset != 0){
                 FieldPtr = this->addPtrTo(nullptr, Field);
-                Current->addTarget(FieldPtr, (CFLGraph->getOrInsertOffsetEdgeLabel(offset)));
+                auto *Label = CFLGraph->getOrInsertFieldEdgeLabel(Current, DyckGraphEdgeLabel::LT_Offset, offset);
+                Current->addTarget(FieldPtr, Label);
             }
 
             // the label representation and feature impl is temporal.
@@ -423,7 +695,9 @@ DyckGraphNode *AAAnalyzer::handleGEP(GEPOperator *GEP) {
                     auto DLayout = this->Mod->getDataLayout();
                     size_t size = DLayout.getTypeAllocSize(ElementType);
                     DyckGraphNode *Element =  this->CFLGraph->retrieveDyckVertex(nullptr).first;
-                    Current->addTarget(Element, this->CFLGraph->getOrInsertOffsetEdgeLabel(size * FieldIdx));
+                    auto *Label = CFLGraph->getOrInsertFieldEdgeLabel(Current, DyckGraphEdgeLabel::LT_Offset,
+                                                                      size * FieldIdx);
+                    Current->addTarget(Element, Label);
                     Current = Element;
                 }
 
@@ -443,7 +717,9 @@ DyckGraphNode *AAAnalyzer::handleGEP(GEPOperator *GEP) {
                     auto size = DLayout.getTypeAllocSize(GTI.getIndexedType());
                     // create a new node to represent the offset relation.
                     DyckGraphNode *Element = this->CFLGraph->retrieveDyckVertex(nullptr).first;
-                    Current->addTarget(Element, this->CFLGraph->getOrInsertOffsetEdgeLabel(size * FieldIdx));
+                    auto *Label = CFLGraph->getOrInsertFieldEdgeLabel(Current, DyckGraphEdgeLabel::LT_Offset,
+                                                                      size * FieldIdx);
+                    Current->addTarget(Element, Label);
                     Current = Element;
                 }
 
@@ -470,6 +746,16 @@ DyckGraphNode *AAAnalyzer::handleGEP(GEPOperator *GEP) {
 }
 
 DyckGraphNode *AAAnalyzer::wrapValue(Value *V) {
+    // a substituted instruction shares the vertex of the value it is copied from
+    auto SIt = Substitutes.find(V);
+    if (SIt != Substitutes.end()) {
+        if (auto *Found = CFLGraph->findDyckVertex(V)) return Found;
+        wrapValue(SIt->second);
+        auto *Node = CFLGraph->findDyckVertex(SIt->second);
+        CFLGraph->substituteDyckVertex(V, Node);
+        return Node;
+    }
+
     // if the vertex of v exists, return it, otherwise create one
     std::pair<DyckGraphNode *, bool> RetPair = CFLGraph->retrieveDyckVertex(V);
     if (RetPair.second || !V) {
@@ -566,7 +852,10 @@ DyckGraphNode *AAAnalyzer::wrapValue(Value *V) {
         }
         VDV = wrapValue(V);
     } else if (isa<GlobalValue>(V)) {
-        if (isa<GlobalVariable>(V)) {
+        if (IntraResult && !isa<Function>(V)) {
+            // globals are shared by all functions, they are handled when merging
+            IntraResult->Globals.push_back((GlobalValue *) V);
+        } else if (isa<GlobalVariable>(V)) {
             auto *Global = (GlobalVariable *) V;
             if (Global->hasInitializer()) {
                 Value *Initializer = Global->getInitializer();
@@ -988,7 +1277,7 @@ void AAAnalyzer::handleInvokeCallInst(Instruction *Ret, Value *CV, std::vector<V
             handleInstrinsic((Instruction *) Ret);
         } else {
             this->handleLibInvokeCallInst(Ret, (Function *) CV, Args, Parent);
-            Parent->addCommonCall(new CommonCall(Ret, (Function *) CV, Args));
+            addCommonCall(Parent, Ret, (Function *) CV, Args);
         }
     } else {
         wrapValue(CV);
@@ -1000,10 +1289,9 @@ void AAAnalyzer::handleInvokeCallInst(Instruction *Ret, Value *CV, std::vector<V
 
             if (isa<Function>(CVCopy)) {
                 this->handleLibInvokeCallInst(Ret, (Function *) CVCopy, Args, Parent);
-                Parent->addCommonCall(new CommonCall(Ret, (Function *) CVCopy, Args));
+                addCommonCall(Parent, Ret, (Function *) CVCopy, Args);
             } else {
-                auto *PCall = new PointerCall(Ret, CV, Args);
-                Parent->addPointerCall(PCall);
+                addPointerCall(Parent, Ret, CV, Args);
             }
         } else if (isa<GlobalAlias>(CV)) {
             Value *CVCopy = CV;
@@ -1013,14 +1301,12 @@ void AAAnalyzer::handleInvokeCallInst(Instruction *Ret, Value *CV, std::vector<V
 
             if (isa<Function>(CVCopy)) {
                 this->handleLibInvokeCallInst(Ret, (Function *) CVCopy, Args, Parent);
-                Parent->addCommonCall(new CommonCall(Ret, (Function *) CVCopy, Args));
+                addCommonCall(Parent, Ret, (Function *) CVCopy, Args);
             } else {
-                auto *PCall = new PointerCall(Ret, CV, Args);
-                Parent->addPointerCall(PCall);
+                addPointerCall(Parent, Ret, CV, Args);
             }
         } else {
-            auto *PCall = new PointerCall(Ret, CV, Args);
-            Parent->addPointerCall(PCall);
+            addPointerCall(Parent, Ret, CV, Args);
         }
     }
 }
@@ -1120,9 +1406,18 @@ bool AAAnalyzer::handlePointerFunctionCalls(DyckCallGraphNode *Caller, int Count
 
         // handle each unhandled, possible function
         std::set<Value *> EquivAndTypeCompSet;
-        auto *EquivSet = (const std::set<Value *> *) CFLGraph->retrieveDyckVertex(PCalledVal).first->getEquivalentSet();
+        auto &EquivSet = CFLGraph->retrieveDyckVertex(PCalledVal).first->getEquivalentValues();
+        if (IncrementalPointerCalls) {
+            // the candidates only depend on the alias set, which never shrinks
+            auto &HandledSize = HandledAliasSetSizes[PCall];
+            if (HandledSize == EquivSet.size()) {
+                PCIt++;
+                continue;
+            }
+            HandledSize = EquivSet.size();
+        }
         // std::set<Function *> *Cands = this->getCompatibleFunctions((FunctionType *) FTy);
-        for(auto ValueIt = EquivSet->begin(); ValueIt != EquivSet->end(); ValueIt ++){
+        for(auto ValueIt = EquivSet.begin(); ValueIt != EquivSet.end(); ValueIt ++){
             Value * Val = *ValueIt;
             if(auto FVal = dyn_cast<Function>(Val)){
                 if(FVal->getFunctionType() == FTy){
@@ -1162,82 +1457,107 @@ bool AAAnalyzer::handlePointerFunctionCalls(DyckCallGraphNode *Caller, int Count
     return Ret;
 }
 
+namespace {
+/// how a call to a library function is modeled
+enum LibraryModelKind {
+    LMK_None,
+    LMK_ContentAlias,     ///< content alias r/1st, e.g., strdup
+    LMK_Copy,             ///< content alias 1st/2nd and alias r/1st, e.g., strcpy
+    LMK_Search,           ///< content alias r/2nd and alias r/1st, e.g., strstr
+    LMK_Alias,            ///< alias r/1st, e.g., strchr
+    LMK_GetSpecific,      ///< r is the value of the key 1st
+    LMK_SetSpecific,      ///< 2nd is the value of the key 1st
+    LMK_ThreadCreate,     ///< the 3rd is called with the 4th
+};
+
+struct LibraryModel {
+    const char *Name;
+    unsigned NumArgs;
+    LibraryModelKind Kind;
+};
+
+/// the library functions modeled by handleLibInvokeCallInst
+const LibraryModel LibraryModels[] = {
+        {"strdup", 1, LMK_ContentAlias}, {"__strdup", 1, LMK_ContentAlias}, {"strdupa", 1, LMK_ContentAlias},
+        {"strndup", 2, LMK_ContentAlias}, {"strndupa", 2, LMK_ContentAlias}, {"strtok", 2, LMK_ContentAlias},
+        {"strtok_r", 3, LMK_ContentAlias}, {"__strtok_r", 3, LMK_ContentAlias},
+        {"strcat", 2, LMK_Copy}, {"strcpy", 2, LMK_Copy},
+        {"strncat", 3, LMK_Copy}, {"strncpy", 3, LMK_Copy}, {"memcpy", 3, LMK_Copy}, {"memmove", 3, LMK_Copy},
+        {"strstr", 2, LMK_Search}, {"strcasestr", 2, LMK_Search},
+        {"strchr", 2, LMK_Alias}, {"strrchr", 2, LMK_Alias}, {"strchrnul", 2, LMK_Alias}, {"rawmemchr", 2, LMK_Alias},
+        {"memchr", 3, LMK_Alias}, {"memrchr", 3, LMK_Alias}, {"memset", 3, LMK_Alias},
+        {"pthread_getspecific", 1, LMK_GetSpecific},
+        {"pthread_setspecific", 2, LMK_SetSpecific},
+        {"pthread_create", 4, LMK_ThreadCreate},
+};
+
+const LibraryModel *getLibraryModel(StringRef Name) {
+    static const StringMap<const LibraryModel *> Models = [] {
+        StringMap<const LibraryModel *> Ret;
+        for (auto &Model: LibraryModels) Ret[Model.Name] = &Model;
+        return Ret;
+    }();
+    auto It = Models.find(Name);
+    return It == Models.end() ? nullptr : It->second;
+}
+} // namespace
+
+bool AAAnalyzer::hasLibraryModel(const Function *F) {
+    return getLibraryModel(F->getName());
+}
+
 void AAAnalyzer::handleLibInvokeCallInst(Value *Ret, Function *F, const std::vector<Value *> *Args,
                                          DyckCallGraphNode *Parent) {
     // args must be the real arguments, not the parameters.
     if (!F->empty() || F->isIntrinsic())
         return;
 
-    auto FName = F->getName();
-    switch (Args->size()) {
-        case 1: {
-            if (FName == "strdup" || FName == "__strdup" || FName == "strdupa") {
-                // content alias r/1st
-                this->makeContentAlias(wrapValue(Args->at(0)), wrapValue(Ret));
-            } else if (FName == "pthread_getspecific" && Ret) {
-                DyckGraphNode *KeyRep = wrapValue(Args->at(0));
-                DyckGraphNode *ValRep = wrapValue(Ret);
-                // we use label -1 to indicate that it is a key:value pair
-                KeyRep->addTarget(ValRep, CFLGraph->getOrInsertIndexEdgeLabel(-1));
-            }
-        }
+    auto *Model = getLibraryModel(F->getName());
+    if (!Model || Model->NumArgs != Args->size())
+        return;
+
+    switch (Model->Kind) {
+        case LMK_ContentAlias:
+            this->makeContentAlias(wrapValue(Args->at(0)), wrapValue(Ret));
             break;
-        case 2: {
-            if (FName == "strcat" || FName == "strcpy") {
-                if (Ret) {
-                    DyckGraphNode *DstPtr = wrapValue(Args->at(0));
-                    DyckGraphNode *SrcPtr = wrapValue(Args->at(1));
-
-                    this->makeContentAlias(DstPtr, SrcPtr);
-                    this->makeAlias(wrapValue(Ret), DstPtr);
-                } else {
-                    errs() << "ERROR strcat/cpy does not return.\n";
-                    exit(1);
-                }
-            } else if (FName == "strndup" || FName == "strndupa" || FName == "strtok") {
-                // content alias r/1st
-                this->makeContentAlias(wrapValue(Args->at(0)), wrapValue(Ret));
-            } else if (FName == "strstr" || FName == "strcasestr") {
-                // content alias r/2nd
-                this->makeContentAlias(wrapValue(Args->at(1)), wrapValue(Ret));
-                // alias r/1st
-                this->makeAlias(wrapValue(Ret), wrapValue(Args->at(0)));
-            } else if (FName == "strchr" || FName == "strrchr" || FName == "strchrnul" || FName == "rawmemchr") {
-                // alias r/1st
-                this->makeAlias(wrapValue(Ret), wrapValue(Args->at(0)));
-            } else if (FName == "pthread_setspecific") {
-                DyckGraphNode *KeyRep = wrapValue(Args->at(0));
-                DyckGraphNode *ValRep = wrapValue(Args->at(1));
-                // we use label -1 to indicate that it is a key:value pair
-                KeyRep->addTarget(ValRep, CFLGraph->getOrInsertIndexEdgeLabel(-1));
+        case LMK_Copy: {
+            if (Ret) {
+                DyckGraphNode *DstPtr = wrapValue(Args->at(0));
+                DyckGraphNode *SrcPtr = wrapValue(Args->at(1));
+
+                this->makeContentAlias(DstPtr, SrcPtr);
+                this->makeAlias(wrapValue(Ret), DstPtr);
+            } else {
+                errs() << "ERROR " << Model->Name << " does not return.\n";
+                exit(1);
             }
         }
             break;
-        case 3: {
-            if (FName == "strncat" || FName == "strncpy" || FName == "memcpy" || FName == "memmove") {
-                if (Ret) {
-                    DyckGraphNode *DstPtr = wrapValue(Args->at(0));
-                    DyckGraphNode *SrcPtr = wrapValue(Args->at(1));
-
-                    this->makeContentAlias(DstPtr, SrcPtr);
-                    this->makeAlias(wrapValue(Ret), DstPtr);
-                } else {
-                    errs() << "ERROR strncat/cpy does not return.\n";
-                    exit(1);
-                }
-            } else if (FName == "memchr" || FName == "memrchr" || FName == "memset") {
-                // alias r/1st
-                this->makeAlias(wrapValue(Ret), wrapValue(Args->at(0)));
-            } else if (FName == "strtok_r" || FName == "__strtok_r") {
-                // content alias r/1st
-                this->makeContentAlias(wrapValue(Args->at(0)), wrapValue(Ret));
-            }
+        case LMK_Search:
+            this->makeContentAlias(wrapValue(Args->at(1)), wrapValue(Ret));
+            this->makeAlias(wrapValue(Ret), wrapValue(Args->at(0)));
+            break;
+        case LMK_Alias:
+            this->makeAlias(wrapValue(Ret), wrapValue(Args->at(0)));
+            break;
+        case LMK_GetSpecific:
+        case LMK_SetSpecific: {
+            if (!Ret && Model->Kind == LMK_GetSpecific)
+                break;
+            DyckGraphNode *KeyRep = wrapValue(Args->at(0));
+            DyckGraphNode *ValRep = wrapValue(Model->Kind == LMK_GetSpecific ? Ret : Args->at(1));
+            // we use label -1 to indicate that it is a key:value pair
+            KeyRep->addTarget(ValRep, CFLGraph->getOrInsertIndexEdgeLabel(-1));
         }
             break;
-        case 4: {
-            if (FName == "pthread_create") {
-                std::vector<Value *> XArgs;
-                XArgs.push_back(Args->at(3));
+        case LMK_ThreadCreate: {
+            std::vector<Value *> XArgs;
+            XArgs.push_back(Args->at(3));
+            if (IntraResult) {
+                // the node of pthread_create is shared by all functions, it is updated when merging
+                IntraResult->Calls.push_back({IntraProcedureResult::CallRecord::CRK_Thread,
+                                              DyckCG->getOrInsertFunction(F), nullptr, Args->at(2), XArgs});
+            } else {
                 handleInvokeCallInst(nullptr, Args->at(2), &XArgs, DyckCG->getOrInsertFunction(F));
             }
         }
@@ -20,6 +20,7 @@
 #define DYCKAA_AAANALYZER_H
 
 #include <cstddef>
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/GetElementPtrTypeIterator.h>
@@ -46,6 +47,32 @@ typedef struct FunctionTypeNode {
     std::set<Function *> CompatibleFuncs;
 } FunctionTypeNode;
 
+/// The result of the intra-procedural analysis of a function on a worker thread.
+/// It is merged into the shared graphs in the order of functions, so that the merged graphs
+/// do not depend on how the functions are scheduled.
+struct IntraProcedureResult {
+    /// the constraints of the function, in a function-local graph
+    DyckGraph Graph;
+
+    /// the globals used in the function, whose initializers are handled when merging
+    std::vector<GlobalValue *> Globals;
+
+    /// the calls found in the function, in the order they are found
+    /// a call is created and added to the call graph when merging, to keep the call ids deterministic
+    struct CallRecord {
+        enum CallRecordKind {
+            CRK_Common, CRK_Pointer, CRK_Thread
+        } Kind;
+        /// the caller, or pthread_create for CRK_Thread
+        DyckCallGraphNode *Parent;
+        Instruction *Inst;
+        /// the callee, or the thread routine for CRK_Thread
+        Value *CalledValue;
+        std::vector<Value *> Args;
+    };
+    std::vector<CallRecord> Calls;
+};
+
 class AAAnalyzer {
 private:
     Module *Mod;
@@ -53,12 +80,22 @@ private:
     DyckGraph *CFLGraph;
     DyckCallGraph *DyckCG;
 
+    /// not null if the analyzer works for a worker thread,
+    /// in which case CFLGraph is the function-local graph of the result
+    IntraProcedureResult *IntraResult;
+
     /// For checking compatible functions of a function pointer
     /// @{
     std::map<Type *, FunctionTypeNode *> FunctionTyNodeMap;
     std::set<FunctionTypeNode *> TyRoots;
     /// @}
 
+    /// pointer call -> the size of the alias set of its called value when it was last handled
+    std::unordered_map<PointerCall *, size_t> HandledAliasSetSizes;
+
+    /// instruction -> the value whose vertex the instruction shares, see computeSubstitutes
+    DenseMap<Value *, Value *> Substitutes;
+
 public:
     AAAnalyzer(Module *, DyckGraph *, DyckCallGraph *);
 
@@ -66,9 +103,36 @@ public:
 
     void intraProcedureAnalysis();
 
+    /// Analyze only the functions \p Funcs, which have been added or defined since the results of the module
+    /// were restored from a cache, i.e., the restored graphs are a fixed point of the other functions.
+    void intraProcedureAnalysis(const std::vector<Function *> &Funcs);
+
     void interProcedureAnalysis();
 
+    /// A string of the option values that affect the analysis results, used to key cached results.
+    static std::string getConfiguration();
+
+    /// Return true if calls to the declaration \p F are modeled as a library function,
+    /// which are not modeled any more once the function is defined.
+    static bool hasLibraryModel(const Function *F);
+
 private:
+    /// the analyzer used by a worker thread to analyze a single function
+    AAAnalyzer(Module *, DyckCallGraph *, IntraProcedureResult *);
+
+    void analyzeFunctions(const std::vector<Function *> &Funcs);
+
+    void mergeIntraProcedureResult(IntraProcedureResult *);
+
+    /// Find the instructions of \p F that are unified with one of their operands anyway, i.e., casts,
+    /// geps of offset zero, phis and selects, and let each of them share the vertex of a value it is
+    /// transitively copied from, so that no vertex is created for it. Return the number of such instructions.
+    unsigned computeSubstitutes(Function *F);
+
+    void addCommonCall(DyckCallGraphNode *Parent, Instruction *Inst, Function *Callee, std::vector<Value *> *Args);
+
+    void addPointerCall(DyckCallGraphNode *Parent, Instruction *Inst, Value *CalledValue, std::vector<Value *> *Args);
+
     void printNoAliasedPointerCalls();
 
     void handleInst(Instruction *Inst, DyckCallGraphNode *Parent);
@@ -0,0 +1,452 @@
+/*
+ *  Canary features a fast unification-based alias analysis for C programs
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/IR/ModuleSlotTracker.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <map>
+
+#include "AAAnalyzer.h"
+#include "DyckAACache.h"
+#include "DyckAA/DyckGraphNode.h"
+
+/// bump the version whenever the layout of the file or the semantics of the analysis changes
+static const uint32_t CacheMagic = 0x4B435944; // "DYCK"
+static const uint32_t CacheVersion = 2;
+static const uint32_t NullRef = ~0U;
+
+enum VertexFlag : uint32_t {
+    VF_ContainsNull = 1U << 0,
+    VF_AliasOfHeapAlloc = 1U << 1,
+    VF_AliasOfDealloc = 1U << 2,
+};
+
+/// the kind of a unit in the low bits, and its flags
+enum UnitFlag : uint32_t {
+    UF_KindMask = 3U,
+    UF_Declaration = 1U << 2,
+    UF_Unnamed = 1U << 3,
+};
+
+/// the flags of each unit, and the name by which it is matched in another version of the module,
+/// where an unnamed unit is named by its position among the unnamed ones
+static std::vector<std::pair<uint32_t, std::string>> getUnitNames(ArrayRef<ModuleNumbering::Unit> Units) {
+    std::vector<std::pair<uint32_t, std::string>> Names;
+    unsigned NumUnnamed = 0;
+    for (auto &U: Units) {
+        uint32_t Flags = isa<GlobalVariable>(U.GV) ? 0 : isa<Function>(U.GV) ? 1 : isa<GlobalAlias>(U.GV) ? 2 : 3;
+        if (U.GV->isDeclaration()) Flags |= UF_Declaration;
+        if (U.GV->hasName()) {
+            Names.emplace_back(Flags, U.GV->getName().str());
+        } else {
+            Names.emplace_back(Flags | UF_Unnamed, std::to_string(NumUnnamed++));
+        }
+    }
+    return Names;
+}
+
+DyckAACache::DyckAACache(Module *M, const ModuleNumbering &Numbering, StringRef Configuration)
+        : M(M), Numbering(Numbering) {
+    MD5 EnvHasher;
+    EnvHasher.update(M->getDataLayoutStr());
+    EnvHasher.update(M->getTargetTriple());
+    EnvHasher.update(Configuration);
+    EnvHasher.final(EnvHash);
+
+    MD5 Hasher;
+    Hasher.update(ArrayRef<uint8_t>(Numbering.getModuleHash().Bytes));
+    Hasher.update(ArrayRef<uint8_t>(EnvHash.Bytes));
+    Hasher.update(ArrayRef<uint8_t>((const uint8_t *) &CacheVersion, sizeof(CacheVersion)));
+    Hasher.final(Hash);
+    Key = Hash.digest().str().str();
+}
+
+std::string DyckAACache::getPath(StringRef Dir, StringRef FileKey) const {
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, FileKey + ".dyckaa");
+    return Path.str().str();
+}
+
+std::string DyckAACache::getLatestPath(StringRef Dir) const {
+    // the source file name stays the same when the module is rebuilt elsewhere, unlike the identifier, which is
+    // the path of the input. a module that only shares the name with another fails the checks of loadPrevious
+    MD5 Hasher;
+    Hasher.update(M->getSourceFileName().empty() ? M->getModuleIdentifier() : M->getSourceFileName());
+    MD5::MD5Result ID;
+    Hasher.final(ID);
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, ID.digest() + ".latest");
+    return Path.str().str();
+}
+
+std::vector<MD5::MD5Result> DyckAACache::hashUnits() const {
+    // the numbers of metadata and attribute groups depend on the rest of the module, so they are left out
+    ModuleSlotTracker MST(M);
+    std::vector<MD5::MD5Result> Hashes;
+    std::string Text, Stripped;
+    for (auto &U: Numbering.units()) {
+        Text.clear();
+        raw_string_ostream OS(Text);
+        U.GV->print(OS, MST);
+        OS.flush();
+        Stripped.clear();
+        for (size_t K = 0; K < Text.size(); ++K) {
+            Stripped.push_back(Text[K]);
+            if (Text[K] != '!' && Text[K] != '#') continue;
+            while (K + 1 < Text.size() && isDigit(Text[K + 1])) ++K;
+        }
+        MD5 Hasher;
+        Hasher.update(Stripped);
+        Hashes.emplace_back();
+        Hasher.final(Hashes.back());
+    }
+    return Hashes;
+}
+
+bool DyckAACache::load(StringRef Dir, DyckGraph *DG, DyckCallGraph *CG) {
+    return read(getPath(Dir, Key), DG, CG, nullptr);
+}
+
+bool DyckAACache::loadPrevious(StringRef Dir, DyckGraph *DG, DyckCallGraph *CG, std::vector<Function *> &Defined) {
+    auto BufferOrErr = MemoryBuffer::getFile(getLatestPath(Dir), /* IsText */ false);
+    if (!BufferOrErr) return false;
+    NumberingReader R((*BufferOrErr)->getBuffer(), None);
+    MD5::MD5Result Latest;
+    if (!R.read(Latest) || !R.atEnd()) return false;
+    Defined.clear();
+    return read(getPath(Dir, Latest.digest()), DG, CG, &Defined);
+}
+
+bool DyckAACache::read(StringRef Path, DyckGraph *DG, DyckCallGraph *CG, std::vector<Function *> *Defined) {
+    // large files are memory-mapped
+    auto BufferOrErr = MemoryBuffer::getFile(Path, /* IsText */ false, /* RequiresNullTerminator */ false);
+    if (!BufferOrErr) return false;
+    NumberingReader R((*BufferOrErr)->getBuffer(), Numbering.values());
+
+    // header
+    uint32_t Word, NumValues;
+    MD5::MD5Result FileHash, FileEnvHash;
+    if (!R.read(Word) || Word != CacheMagic) return false;
+    if (!R.read(Word) || Word != CacheVersion) return false;
+    if (!R.read(FileHash) || !R.read(NumValues) || !R.read(FileEnvHash)) return false;
+    if (!Defined && (!(FileHash == Hash) || NumValues != Numbering.size())) return false;
+    if (Defined && !(FileEnvHash == EnvHash)) return false;
+
+    // units, by which the values of a previous version are mapped to the current module
+    auto Units = Numbering.units();
+    std::map<std::pair<uint32_t, std::string>, unsigned> UnitIndices;
+    std::vector<MD5::MD5Result> UnitHashes;
+    std::vector<bool> ToAnalyze;
+    std::vector<Value *> Values;
+    if (Defined) {
+        auto Names = getUnitNames(Units);
+        for (unsigned K = 0; K < Names.size(); ++K) {
+            // the declaration flag is not a part of the name
+            UnitIndices.emplace(std::make_pair(Names[K].first & ~UF_Declaration, Names[K].second), K);
+        }
+        UnitHashes = hashUnits();
+        ToAnalyze.resize(Units.size(), true);
+        Values.resize(NumValues, nullptr);
+    }
+    uint32_t NumUnits;
+    if (!R.read(NumUnits)) return false;
+    for (uint32_t K = 0; K < NumUnits; ++K) {
+        uint32_t Flags, NameSize, Begin, End;
+        std::string Name;
+        MD5::MD5Result UnitHash;
+        if (!R.read(Flags) || !R.read(NameSize) || !R.read(Name, NameSize) || !R.read(UnitHash)) return false;
+        if (!R.read(Begin) || !R.read(End) || Begin > End || End > NumValues) return false;
+        if (!Defined) continue;
+
+        auto It = UnitIndices.find(std::make_pair(Flags & ~UF_Declaration, Name));
+        if (It == UnitIndices.end()) return false;
+        auto &U = Units[It->second];
+        if (UnitHash == UnitHashes[It->second]) {
+            if (End - Begin != U.End - U.Begin) return false;
+            ToAnalyze[It->second] = false;
+        } else if ((Flags & UF_KindMask) == 1 && (Flags & UF_Declaration) && !U.GV->isDeclaration() &&
+                   !AAAnalyzer::hasLibraryModel(cast<Function>(U.GV))) {
+            // the values of a declaration are a prefix of the values of its definition
+            if (End - Begin > U.End - U.Begin) return false;
+        } else {
+            // an edited unit may have contributed merges that no longer hold, which cannot be retracted
+            return false;
+        }
+        std::copy(Numbering.values().begin() + U.Begin, Numbering.values().begin() + U.Begin + (End - Begin),
+                  Values.begin() + Begin);
+    }
+    if (Defined) {
+        R.setValues(Values);
+        for (unsigned K = 0; K < Units.size(); ++K) {
+            auto *F = dyn_cast<Function>(Units[K].GV);
+            if (ToAnalyze[K] && F && !F->isDeclaration()) Defined->push_back(F);
+        }
+    }
+
+    // labels, which are created in the order of their ids
+    std::vector<DyckGraphEdgeLabel *> Labels(1, DG->getDereferenceEdgeLabel());
+    uint32_t NumLabels;
+    if (!R.read(NumLabels)) return false;
+    for (uint32_t K = 0; K < NumLabels; ++K) {
+        uint32_t Kind, Low, High;
+        if (!R.read(Kind) || !R.read(Low) || !R.read(High)) return false;
+        long Field = (long) (((uint64_t) High << 32) | Low);
+        DyckGraphEdgeLabel *Label;
+        if (Kind == DyckGraphEdgeLabel::LT_Offset)
+            Label = Field == PointerOffsetEdgeLabel::AnyOffset ? DG->getCollapsedEdgeLabel(DyckGraphEdgeLabel::LT_Offset)
+                                                               : DG->getOrInsertOffsetEdgeLabel(Field);
+        else if (Kind == DyckGraphEdgeLabel::LT_Index)
+            Label = Field == FieldIndexEdgeLabel::AnyIndex ? DG->getCollapsedEdgeLabel(DyckGraphEdgeLabel::LT_Index)
+                                                           : DG->getOrInsertIndexEdgeLabel(Field);
+        else
+            return false;
+        if (Label->getLabelID() != Labels.size()) return false;
+        Labels.push_back(Label);
+    }
+
+    // vertices with their equivalence classes
+    std::vector<DyckGraphNode *> Nodes;
+    uint32_t NumNodes;
+    if (!R.read(NumNodes)) return false;
+    Nodes.reserve(NumNodes);
+    for (uint32_t K = 0; K < NumNodes; ++K) {
+        uint32_t Flags, NumVals;
+        if (!R.read(Flags) || !R.read(NumVals)) return false;
+        auto *Node = DG->retrieveDyckVertex(nullptr).first;
+        if (Flags & VF_ContainsNull) Node->setContainsNull();
+        if (Flags & VF_AliasOfHeapAlloc) Node->setAliasOfHeapAlloc();
+        if (Flags & VF_AliasOfDealloc) Node->setAliasOfDealloc();
+        for (uint32_t J = 0; J < NumVals; ++J) {
+            Value *V;
+            if (!R.read(V)) return false;
+            if (!DG->ValVertexMap.emplace(V, Node->getIndex()).second) return false;
+            Node->addEquivalentValue(V);
+        }
+        Nodes.push_back(Node);
+    }
+
+    // labelled edges
+    uint32_t NumEdges;
+    if (!R.read(NumEdges)) return false;
+    for (uint32_t K = 0; K < NumEdges; ++K) {
+        uint32_t Src, Label, Dst;
+        if (!R.read(Src) || !R.read(Label) || !R.read(Dst)) return false;
+        if (Src >= Nodes.size() || Label >= Labels.size() || Dst >= Nodes.size()) return false;
+        Nodes[Src]->addTarget(Nodes[Dst], Labels[Label]);
+    }
+
+    // the call graph, whose nodes are created in the same order as the intra-procedural analysis does
+    for (auto &F: *M) {
+        if (!F.isIntrinsic()) CG->getOrInsertFunction(&F);
+    }
+    uint32_t NumFunctions;
+    if (!R.read(NumFunctions)) return false;
+    for (uint32_t K = 0; K < NumFunctions; ++K) {
+        Function *F;
+        if (!R.read(F)) return false;
+        auto *CGNode = CG->getOrInsertFunction(F);
+
+        uint32_t Num;
+        if (!R.read(Num)) return false;
+        for (uint32_t J = 0; J < Num; ++J) {
+            BasicBlock *BB;
+            if (!R.read(BB)) return false;
+            CGNode->addRetBB(BB);
+        }
+        if (!R.read(Num)) return false;
+        for (uint32_t J = 0; J < Num; ++J) {
+            Value *Ret;
+            if (!R.read(Ret)) return false;
+            CGNode->addRet(Ret);
+        }
+        if (!R.read(Num)) return false;
+        for (uint32_t J = 0; J < Num; ++J) {
+            Value *VAArg;
+            if (!R.read(VAArg)) return false;
+            CGNode->addVAArg(VAArg);
+        }
+
+        std::vector<Call *> Calls;
+        if (!R.read(Num)) return false;
+        for (uint32_t J = 0; J < Num; ++J) {
+            uint32_t Kind, NumArgs;
+            Instruction *Inst;
+            Value *CalledValue;
+            if (!R.read(Kind) || !R.read(Inst, true) || !R.read(CalledValue) || !R.read(NumArgs)) return false;
+            std::vector<Value *> Args(NumArgs);
+            for (auto &Arg: Args) {
+                if (!R.read(Arg)) return false;
+            }
+            if (Kind == Call::CK_Common) {
+                if (!isa<Function>(CalledValue)) return false;
+                auto *CC = CG->createCommonCall(Inst, cast<Function>(CalledValue), &Args);
+                CGNode->addCommonCall(CC);
+                Calls.push_back(CC);
+            } else if (Kind == Call::CK_Pointer) {
+                auto *PC = CG->createPointerCall(Inst, CalledValue, &Args);
+                CGNode->addPointerCall(PC);
+                Calls.push_back(PC);
+                uint32_t NumCallees;
+                if (!R.read(NumCallees)) return false;
+                for (uint32_t I = 0; I < NumCallees; ++I) {
+                    Function *Callee;
+                    if (!R.read(Callee)) return false;
+                    PC->addMayAliasedFunction(Callee);
+                }
+            } else {
+                return false;
+            }
+        }
+
+        if (!R.read(Num)) return false;
+        for (uint32_t J = 0; J < Num; ++J) {
+            uint32_t CallIdx;
+            Function *Callee;
+            if (!R.read(CallIdx) || !R.read(Callee, true)) return false;
+            if (CallIdx != NullRef && CallIdx >= Calls.size()) return false;
+            if (Defined) continue;
+            CGNode->addCalledFunction(CallIdx == NullRef ? nullptr : Calls[CallIdx], CG->getOrInsertFunction(Callee));
+        }
+    }
+    return R.atEnd();
+}
+
+bool DyckAACache::save(StringRef Dir, DyckGraph *DG, DyckCallGraph *CG) {
+    std::vector<uint32_t> Words;
+    bool Complete = true;
+    auto WriteValue = [this, &Words, &Complete](Value *V) {
+        unsigned ID = V ? Numbering.getID(V) : NullRef;
+        // a value out of the module cannot be found when the file is loaded
+        if (V && ID == ModuleNumbering::InvalidID) Complete = false;
+        Words.push_back(ID);
+    };
+
+    // header
+    Words.push_back(CacheMagic);
+    Words.push_back(CacheVersion);
+    appendWords(Words, Hash);
+    Words.push_back(Numbering.size());
+    appendWords(Words, EnvHash);
+
+    // units
+    auto Units = Numbering.units();
+    auto Names = getUnitNames(Units);
+    auto UnitHashes = hashUnits();
+    Words.push_back(Units.size());
+    for (unsigned K = 0; K < Units.size(); ++K) {
+        Words.push_back(Names[K].first);
+        Words.push_back(Names[K].second.size());
+        appendWords(Words, Names[K].second);
+        appendWords(Words, UnitHashes[K]);
+        Words.push_back(Units[K].Begin);
+        Words.push_back(Units[K].End);
+    }
+
+    // labels except the dereference label, in the order of their ids
+    std::vector<DyckGraphEdgeLabel *> Labels(DG->NumEdgeLabels, nullptr);
+    for (auto &It: DG->OffsetEdgeLabelMap) Labels[It.second->getLabelID()] = It.second;
+    for (auto &It: DG->IndexEdgeLabelMap) Labels[It.second->getLabelID()] = It.second;
+    Words.push_back(Labels.size() - 1);
+    for (unsigned K = 1; K < Labels.size(); ++K) {
+        uint64_t Field;
+        if (Labels[K]->isLabelTy(DyckGraphEdgeLabel::LT_Offset)) {
+            Words.push_back(DyckGraphEdgeLabel::LT_Offset);
+            Field = (uint64_t) ((PointerOffsetEdgeLabel *) Labels[K])->getOffsetBytes();
+        } else {
+            Words.push_back(DyckGraphEdgeLabel::LT_Index);
+            Field = (uint64_t) ((FieldIndexEdgeLabel *) Labels[K])->getFieldIndex();
+        }
+        Words.push_back((uint32_t) Field);
+        Words.push_back((uint32_t) (Field >> 32));
+    }
+
+    // vertices, which are renumbered densely
+    DenseMap<DyckGraphNode *, uint32_t> NodeIDs;
+    for (auto *Node: DG->getVertices()) NodeIDs.try_emplace(Node, NodeIDs.size());
+    Words.push_back(NodeIDs.size());
+    for (auto *Node: DG->getVertices()) {
+        uint32_t Flags = 0;
+        if (Node->containsNull()) Flags |= VF_ContainsNull;
+        if (Node->isAliasOfHeapAlloc()) Flags |= VF_AliasOfHeapAlloc;
+        if (Node->isAliasOfDealloc()) Flags |= VF_AliasOfDealloc;
+        Words.push_back(Flags);
+        auto &EquivSet = Node->getEquivalentValues();
+        Words.push_back(EquivSet.size());
+        for (auto *V: EquivSet) WriteValue(V);
+    }
+
+    // edges
+    size_t NumEdgesPos = Words.size();
+    Words.push_back(0);
+    for (auto *Node: DG->getVertices()) {
+        for (auto &Out: Node->getOutVertices()) {
+            for (auto *Target: Out.second) {
+                Words.push_back(NodeIDs.lookup(Node));
+                Words.push_back(Out.first->getLabelID());
+                Words.push_back(NodeIDs.lookup(Target));
+                ++Words[NumEdgesPos];
+            }
+        }
+    }
+
+    // call graph, the external calling node is rebuilt automatically
+    size_t NumFunctionsPos = Words.size();
+    Words.push_back(0);
+    for (auto *CGNode: make_range(CG->nodes_begin(), CG->nodes_end())) {
+        if (!CGNode->getLLVMFunction()) continue;
+        ++Words[NumFunctionsPos];
+        WriteValue(CGNode->getLLVMFunction());
+
+        std::vector<BasicBlock *> RetBBs(CGNode->return_bb_begin(), CGNode->return_bb_end());
+        Words.push_back(RetBBs.size());
+        for (auto *BB: RetBBs) WriteValue(BB);
+        Words.push_back(CGNode->getReturns().size());
+        for (auto *Ret: CGNode->getReturns()) WriteValue(Ret);
+        Words.push_back(CGNode->getVAArgs().size());
+        for (auto *VAArg: CGNode->getVAArgs()) WriteValue(VAArg);
+
+        DenseMap<Call *, uint32_t> CallIDs;
+        Words.push_back(CGNode->common_call_size() + CGNode->pointer_call_size());
+        auto WriteCall = [&](Call *C) {
+            CallIDs.try_emplace(C, CallIDs.size());
+            Words.push_back(C->getKind());
+            WriteValue(C->getInstruction());
+            WriteValue(C->getCalledValue());
+            Words.push_back(C->numArgs());
+            for (auto *Arg: C->getArgs()) WriteValue(Arg);
+        };
+        for (auto It = CGNode->common_call_begin(), E = CGNode->common_call_end(); It != E; ++It) WriteCall(*It);
+        for (auto It = CGNode->pointer_call_begin(), E = CGNode->pointer_call_end(); It != E; ++It) {
+            WriteCall(*It);
+            Words.push_back((*It)->size());
+            for (auto *Callee: **It) WriteValue(Callee);
+        }
+
+        Words.push_back(CGNode->child_edge_end() - CGNode->child_edge_begin());
+        for (auto It = CGNode->child_edge_begin(), E = CGNode->child_edge_end(); It != E; ++It) {
+            Words.push_back(It->first ? CallIDs.lookup(It->first) : NullRef);
+            WriteValue(It->second->getLLVMFunction());
+        }
+    }
+    if (!Complete || !writeNumberedFile(getPath(Dir, Key), Words)) return false;
+
+    std::vector<uint32_t> Latest;
+    appendWords(Latest, Hash);
+    return writeNumberedFile(getLatestPath(Dir), Latest);
+}
@@ -0,0 +1,87 @@
+/*
+ *  Canary features a fast unification-based alias analysis for C programs
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DYCKAA_DYCKAACACHE_H
+#define DYCKAA_DYCKAACACHE_H
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MD5.h>
+#include <string>
+
+#include "DyckAA/DyckCallGraph.h"
+#include "DyckAA/DyckGraph.h"
+#include "ModuleNumbering.h"
+
+using namespace llvm;
+
+/// A persistent on-disk cache of the final results of DyckAA, i.e., the equivalence classes, the labelled edges,
+/// the flags of the vertices, and the call graph with the resolved targets of pointer calls.
+/// A cache file is keyed by the hash of the module's bitcode and the analysis options, and refers to values by
+/// their numbers in the ModuleNumbering. It also records the hash of each unit of the module, so that the results
+/// of a previous version of the module can be reused if the module has only been extended since then.
+/// The file is a stream of little-endian 32-bit words, which is memory-mapped when loaded.
+class DyckAACache {
+private:
+    Module *M;
+
+    const ModuleNumbering &Numbering;
+
+    /// the hash of the data layout, the target and the analysis options
+    MD5::MD5Result EnvHash;
+
+    /// the hash of the module and the analysis options, and its hex string
+    /// @{
+    MD5::MD5Result Hash;
+    std::string Key;
+    /// @}
+
+public:
+    /// \p Numbering is the numbering of \p M, which must outlive the cache
+    DyckAACache(Module *M, const ModuleNumbering &Numbering, StringRef Configuration);
+
+    /// Build the graphs from the cache file of the module in the directory, which must be empty graphs.
+    /// Return false if there is no such file or it is malformed,
+    /// in which case the graphs may have been partially built and must be discarded.
+    bool load(StringRef Dir, DyckGraph *DG, DyckCallGraph *CG);
+
+    /// Build the graphs from the cache file of the last analyzed version of the module in the directory, which is
+    /// found by the source file name of the module. It succeeds only if the results are a sound and precise
+    /// starting point, i.e., no unit of that version has been changed, except that functions without library
+    /// models may have been defined. Unification cannot be undone and nothing is retracted, so any other change
+    /// requires a full analysis. Only the alias analysis resumes; mod/ref, the VFG and the slices are rebuilt.
+    /// The new and newly defined functions, which are still to be analyzed, are returned by \p Defined.
+    /// The call records are not restored, which are to be rebuilt by the inter-procedural analysis.
+    bool loadPrevious(StringRef Dir, DyckGraph *DG, DyckCallGraph *CG, std::vector<Function *> &Defined);
+
+    /// Write the graphs into the cache file of the module in the directory,
+    /// and make it the last analyzed version of the module. Return false if they cannot be saved.
+    bool save(StringRef Dir, DyckGraph *DG, DyckCallGraph *CG);
+
+private:
+    std::string getPath(StringRef Dir, StringRef FileKey) const;
+
+    std::string getLatestPath(StringRef Dir) const;
+
+    bool read(StringRef Path, DyckGraph *DG, DyckCallGraph *CG, std::vector<Function *> *Defined);
+
+    /// the hash of the printed text of each unit, in the order of units
+    std::vector<MD5::MD5Result> hashUnits() const;
+};
+
+#endif // DYCKAA_DYCKAACACHE_H
@@ -25,6 +25,7 @@
 #include <string>
 
 #include "AAAnalyzer.h"
+#include "DyckAACache.h"
 #include "DyckAA/DyckAliasAnalysis.h"
 #include "DyckAA/DyckCallGraph.h"
 #include "DyckAA/DyckGraph.h"
@@ -61,6 +62,17 @@ cl::opt<std::string> CSourceFunctions("c-source-functions", cl::value_desc("file
 cl::opt<std::string> CSinkFunctions ("c-sink-functions", cl::value_desc("filename"), cl::Hidden, cl::desc("path to file which contains the names of c sink functions."));
 
 
+static cl::opt<std::string> CacheDir("dyckaa-cache-dir", cl::value_desc("directory"), cl::Hidden,
+                                     cl::desc("Load the results of DyckAA from the directory if the module has been "
+                                              "analyzed before, and save the results there otherwise."));
+
+static cl::opt<bool> IncrementalCache("dyckaa-incremental", cl::init(true), cl::Hidden,
+                                      cl::desc("With -dyckaa-cache-dir, start from the results of the last analyzed "
+                                               "version of the module if it has only been extended since then. "
+                                               "Facts are never retracted, so an edited or removed function or "
+                                               "global requires a full analysis. Only DyckAA itself resumes, "
+                                               "the analyses built on it always run in full."));
+
 cl::alias CSrcFunc("csrc", llvm::cl::desc("Alias for -c-source-functions"), llvm::cl::aliasopt(CSourceFunctions));
 cl::alias CSinkFunc("csink", llvm::cl::desc("Alias for -c-sink-functions"), llvm::cl::aliasopt(CSinkFunctions));
 
@@ -83,19 +95,49 @@ void DyckAliasAnalysis::getAnalysisUsage(AnalysisUsage &AU) const {
 }
 
 const std::set<Value *> *DyckAliasAnalysis::getAliasSet(Value *Ptr) const {
-    DyckGraphNode *V = DyckPTG->retrieveDyckVertex(Ptr).first;
-    return (const std::set<Value *> *)V->getEquivalentSet();
+    unsigned ID = getAliasClassID(Ptr);
+    if (ID == InvalidClassID)
+        return nullptr;
+    return (const std::set<Value *> *)ClassVertices[ID]->getEquivalentSet();
 }
 
 bool DyckAliasAnalysis::mayAlias(Value *V1, Value *V2) const {
-    return getAliasSet(V1)->count(V2);
+    // a value that is not analyzed is only an alias of itself
+    if (V1 == V2)
+        return true;
+    unsigned ID1 = getAliasClassID(V1);
+    return ID1 != InvalidClassID && ID1 == getAliasClassID(V2);
+}
+
+void DyckAliasAnalysis::mayAlias(ArrayRef<std::pair<Value *, Value *>> Pairs, SmallVectorImpl<bool> &Results) const {
+    Results.resize(Pairs.size());
+    for (unsigned K = 0; K < Pairs.size(); ++K)
+        Results[K] = mayAlias(Pairs[K].first, Pairs[K].second);
 }
 
 bool DyckAliasAnalysis::mayNull(Value *V) const {
-    auto *DyckNode = DyckPTG->findDyckVertex(V);
-    if (!DyckNode)
+    unsigned ID = getAliasClassID(V);
+    if (ID == InvalidClassID)
         return false;
-    return DyckNode->containsNull();
+    return ClassVertices[ID]->containsNull();
+}
+
+void DyckAliasAnalysis::buildAliasClasses() {
+    ClassIDs.clear();
+    ClassVertices.clear();
+    size_t NumValues = 0;
+    for (auto *DyckNode : DyckPTG->getVertices())
+        NumValues += DyckNode->getEquivalentValues().size();
+    ClassIDs.reserve(NumValues);
+    for (auto *DyckNode : DyckPTG->getVertices()) {
+        auto &AliasSet = DyckNode->getEquivalentValues();
+        if (AliasSet.empty())
+            continue;
+        for (auto *V : AliasSet)
+            ClassIDs.try_emplace(V, ClassVertices.size());
+        ClassVertices.push_back(DyckNode);
+    }
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Alias classes: " << ClassVertices.size() << "\n");
 }
 
 DyckCallGraph *DyckAliasAnalysis::getDyckCallGraph() const {
@@ -106,6 +148,13 @@ DyckGraph *DyckAliasAnalysis::getDyckGraph() const {
     return DyckPTG;
 }
 
+const ModuleNumbering &DyckAliasAnalysis::getModuleNumbering() {
+    assert(Mod && "the module has not been analyzed");
+    if (!Numbering)
+        Numbering = std::make_unique<ModuleNumbering>(Mod);
+    return *Numbering;
+}
+
 bool DyckAliasAnalysis::runOnModule(Module &M) {
     RecursiveTimer DyckAA("Running DyckAA");
     // if(!PrintCSourceFunctionsFlag.getValue().empty()){
@@ -113,24 +162,67 @@ bool DyckAliasAnalysis::runOnModule(Module &M) {
     //     PrintCSourceFunctions = true; 
     // }
     // readCSourceFunctions();
+    API::classifyFunctions(&M);
+    Mod = &M;
+    Numbering.reset();
     // alias analysis
-    AAAnalyzer AA(&M, DyckPTG, DyckCG);
-    AA.intraProcedureAnalysis();
-    AA.interProcedureAnalysis();
+    std::unique_ptr<DyckAACache> Cache;
+    bool Cached = false, Resumed = false;
+    std::vector<Function *> Defined;
+    if (!CacheDir.empty()) {
+        RecursiveTimer LoadTimer("Loading DyckAA cache");
+        // the graphs may have been partially built from a mismatched file
+        auto Reset = [this]() {
+            delete DyckCG;
+            delete DyckPTG;
+            DyckPTG = new DyckGraph;
+            DyckCG = new DyckCallGraph;
+        };
+        Cache = std::make_unique<DyckAACache>(&M, getModuleNumbering(), AAAnalyzer::getConfiguration());
+        Cached = Cache->load(CacheDir, DyckPTG, DyckCG);
+        if (!Cached) {
+            Reset();
+            if (IncrementalCache) {
+                Resumed = Cache->loadPrevious(CacheDir, DyckPTG, DyckCG, Defined);
+                if (!Resumed)
+                    Reset();
+            }
+        }
+        DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Cache hits: " << Cached << "\n");
+        DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Incremental cache hits: " << Resumed << "\n");
+    }
 
-    // a post-processing procedure
-    for (auto *DyckNode : DyckPTG->getVertices()) {
-        auto *AliasSet = (const std::set<Value *> *)DyckNode->getEquivalentSet();
-        if (!AliasSet)
-            continue;
-        for (auto *V : *AliasSet) {
-            if (!isa<ConstantPointerNull>(V))
-                continue;
-            DyckNode->setContainsNull();
-            break;
+    if (!Cached) {
+        AAAnalyzer AA(&M, DyckPTG, DyckCG);
+        if (Resumed)
+            AA.intraProcedureAnalysis(Defined);
+        else
+            AA.intraProcedureAnalysis();
+        AA.interProcedureAnalysis();
+
+        // a post-processing procedure
+        for (auto *DyckNode : DyckPTG->getVertices()) {
+            for (auto *V : DyckNode->getEquivalentValues()) {
+                if (!isa<ConstantPointerNull>(V))
+                    continue;
+                DyckNode->setContainsNull();
+                break;
+            }
+        }
+
+        if (Cache) {
+            RecursiveTimer SaveTimer("Saving DyckAA cache");
+            if (sys::fs::create_directories(CacheDir) || !Cache->save(CacheDir, DyckPTG, DyckCG))
+                errs() << "Warning: cannot save the results of DyckAA into " << CacheDir << "\n";
         }
     }
 
+    buildAliasClasses();
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# DyckGraph arena: " << DyckPTG->getAllocator().getBytesAllocated()
+                                           << " bytes in " << DyckPTG->getAllocator().GetNumSlabs() << " slabs\n");
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# DyckCallGraph arena: " << DyckCG->getAllocator().getBytesAllocated()
+                                           << " bytes in " << DyckCG->getAllocator().GetNumSlabs() << " slabs\n");
+
     /* call graph */
     if (DotCallGraph) {
         outs() << "Printing call graph...\n";
@@ -224,11 +316,11 @@ void DyckAliasAnalysis::printAliasSetInformation() {
 
     std::map<DyckGraphNode *, int> TheMap;
     int Idx = 0;
-    std::set<DyckGraphNode *> &Reps = DyckPTG->getVertices();
+    auto Reps = DyckPTG->getVertices();
     auto RepIt = Reps.begin();
     while (RepIt != Reps.end()) {
       Idx++;
-      std::set<llvm::Value *> *EqSets = (*RepIt)->getEquivalentSet();
+      const std::set<llvm::Value *> *EqSets = (*RepIt)->getEquivalentSet();
       std::string LabelDesc;
       raw_string_ostream LabelDescBuilder(LabelDesc);
       std::string LabelColor("black");
@@ -259,13 +351,12 @@ void DyckAliasAnalysis::printAliasSetInformation() {
     RepIt = Reps.begin();
     while (RepIt != Reps.end()) {
       DyckGraphNode *DGN = *RepIt;
-      std::map<DyckGraphEdgeLabel *, std::set<DyckGraphNode *>> &OutVs =
-          DGN->getOutVertices();
+      DyckGraphEdgeMap &OutVs = DGN->getOutVertices();
 
       auto OvIt = OutVs.begin();
       while (OvIt != OutVs.end()) {
         auto *Label = (DyckGraphEdgeLabel *)OvIt->first;
-        std::set<DyckGraphNode *> *oVs = &OvIt->second;
+        DyckGraphNodeSet *oVs = &OvIt->second;
 
         auto OIt = oVs->begin();
         while (OIt != oVs->end()) {
@@ -307,13 +398,13 @@ void DyckAliasAnalysis::printAliasSetInformation() {
     Log << "===== {.} means pthread escaped alias set =====\n";
 
     // int Idx = 0;
-    std::set<DyckGraphNode *> &Reps = DyckPTG->getVertices();
+    auto Reps = DyckPTG->getVertices();
     auto RepsIt = Reps.begin();
     while (RepsIt != Reps.end()) {
       // Idx++;
       DyckGraphNode *Rep = *RepsIt;
 
-      std::set<llvm::Value *> *ESet = Rep->getEquivalentSet();
+      const std::set<llvm::Value *> *ESet = Rep->getEquivalentSet();
       auto EIt = ESet->begin();
       while (EIt != ESet->end()) {
         auto *Val = (Value *)((*EIt));
@@ -380,5 +471,6 @@ void DyckAliasAnalysis::readCSourceFunctions() {
     std::cout << (*It).str() << std::endl;
     CSFName.insert((*It).str());
   }
-  API::HeapAllocFunctions.insert(CSFName.begin(), CSFName.end());
+  for (auto &Name : CSFName)
+    API::addHeapAllocFunction(Name);
 }
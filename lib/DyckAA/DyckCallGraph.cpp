@@ -25,10 +25,12 @@ DyckCallGraph::DyckCallGraph()
     : ExternalCallingNode(getOrInsertFunction(nullptr)) {}
 
 DyckCallGraph::~DyckCallGraph() {
-    auto It = FunctionMap.begin();
-    while (It != FunctionMap.end()) {
-        delete (It->second);
-        It++;
+    // the memory is released with the arena, the objects only need to be destroyed
+    for (auto &It: FunctionMap) {
+        DyckCallGraphNode *Node = It.second;
+        for (auto CIt = Node->common_call_begin(); CIt != Node->common_call_end(); ++CIt) (*CIt)->~CommonCall();
+        for (auto PIt = Node->pointer_call_begin(); PIt != Node->pointer_call_end(); ++PIt) (*PIt)->~PointerCall();
+        Node->~DyckCallGraphNode();
     }
     FunctionMapTy().swap(FunctionMap);
 }
@@ -36,7 +38,7 @@ DyckCallGraph::~DyckCallGraph() {
 DyckCallGraphNode *DyckCallGraph::getOrInsertFunction(Function *Func) {
     auto It = FunctionMap.find(Func);
     if (It == FunctionMap.end()) {
-        auto *Ret = new DyckCallGraphNode(Func);
+        auto *Ret = new (Allocator.Allocate<DyckCallGraphNode>()) DyckCallGraphNode(Func);
 
         // The following if-statement is copied from llvm's call graph implementation
         // If this function has external linkage or has its address taken and
@@ -50,6 +52,14 @@ DyckCallGraphNode *DyckCallGraph::getOrInsertFunction(Function *Func) {
     return It->second;
 }
 
+CommonCall *DyckCallGraph::createCommonCall(Instruction *Inst, Function *Func, std::vector<Value *> *Args) {
+    return new (Allocator.Allocate<CommonCall>()) CommonCall(Inst, Func, Args);
+}
+
+PointerCall *DyckCallGraph::createPointerCall(Instruction *Inst, Value *CalledValue, std::vector<Value *> *Args) {
+    return new (Allocator.Allocate<PointerCall>()) PointerCall(Inst, CalledValue, Args);
+}
+
 DyckCallGraphNode *DyckCallGraph::getFunction(Function *Func) const {
     auto It = FunctionMap.find(Func);
     if (It == FunctionMap.end())
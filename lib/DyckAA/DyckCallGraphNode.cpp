@@ -43,20 +43,6 @@ DyckCallGraphNode::DyckCallGraphNode(Function *F) : Func(F) {
     for (unsigned K = 0; K < F->arg_size(); ++K) Args.push_back(F->getArg(K));
 }
 
-DyckCallGraphNode::~DyckCallGraphNode() {
-    auto It = PointerCalls.begin();
-    while (It != PointerCalls.end()) {
-        delete (*It);
-        It++;
-    }
-
-    auto CIt = CommonCalls.begin();
-    while (CIt != CommonCalls.end()) {
-        delete *CIt;
-        CIt++;
-    }
-}
-
 void DyckCallGraphNode::addPointerCall(PointerCall *PC) {
     InstructionCallMap.insert(std::pair<Instruction *, Call *>(PC->getInstruction(), PC));
     PointerCalls.insert(PC);
@@ -18,39 +18,43 @@
 
 #include <cassert>
 #include <cstdio>
-#include <stack>
 #include "DyckAA/DyckAliasAnalysis.h"
 #include "DyckAA/DyckGraphEdgeLabel.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Value.h"
 #include "DyckAA/DyckGraph.h"
 #include "Support/API.h"
+#include <llvm/ADT/BitVector.h>
+#include <llvm/Support/CommandLine.h>
 #include <llvm/Support/raw_ostream.h>
-DyckGraph::DyckGraph() {
-    DerefEdgeLabel = new DereferenceEdgeLabel;
+
+static llvm::cl::opt<bool> UnionFindReps("dyck-union-find", llvm::cl::init(true), llvm::cl::Hidden,
+                                         llvm::cl::desc("Look up the vertex of a value through a union-find "
+                                                        "instead of updating the value map on every merge."));
+
+DyckGraph::DyckGraph() : NumLiveVertices(0), NumEdgeLabels(0) {
+    DerefEdgeLabel = new (Allocator.Allocate<DereferenceEdgeLabel>()) DereferenceEdgeLabel;
+    DerefEdgeLabel->LabelID = NumEdgeLabels++;
 }
 
 DyckGraph::~DyckGraph() {
-    for (auto &V: Vertices) delete V;
-
-    delete DerefEdgeLabel;
-    auto OIt = OffsetEdgeLabelMap.begin();
-    while (OIt != OffsetEdgeLabelMap.end()) {
-        delete OIt->second;
-        OIt++;
-    }
-    auto IIt = IndexEdgeLabelMap.begin();
-    while (IIt != IndexEdgeLabelMap.end()) {
-        delete IIt->second;
-        IIt++;
+    clearReachableClosures();
+    // the memory is released with the arena, only the live objects need to be destroyed
+    for (auto *V: Vertices) {
+        if (V) V->~DyckGraphNode();
     }
+
+    DerefEdgeLabel->~DyckGraphEdgeLabel();
+    for (auto &OIt: OffsetEdgeLabelMap) OIt.second->~DyckGraphEdgeLabel();
+    for (auto &IIt: IndexEdgeLabelMap) IIt.second->~DyckGraphEdgeLabel();
 }
 
 DyckGraphEdgeLabel *DyckGraph::getOrInsertOffsetEdgeLabel(long Offset) {
     if (OffsetEdgeLabelMap.count(Offset)) {
         return OffsetEdgeLabelMap[Offset];
     } else {
-        DyckGraphEdgeLabel *Ret = new PointerOffsetEdgeLabel(Offset);
+        DyckGraphEdgeLabel *Ret = new (Allocator.Allocate<PointerOffsetEdgeLabel>()) PointerOffsetEdgeLabel(Offset);
+        Ret->LabelID = NumEdgeLabels++;
         OffsetEdgeLabelMap.insert(std::pair<long, DyckGraphEdgeLabel *>(Offset, Ret));
         return Ret;
     }
@@ -60,28 +64,86 @@ DyckGraphEdgeLabel *DyckGraph::getOrInsertIndexEdgeLabel(long Offset) {
     if (IndexEdgeLabelMap.count(Offset)) {
         return IndexEdgeLabelMap[Offset];
     } else {
-        DyckGraphEdgeLabel *Ret = new FieldIndexEdgeLabel(Offset);
+        DyckGraphEdgeLabel *Ret = new (Allocator.Allocate<FieldIndexEdgeLabel>()) FieldIndexEdgeLabel(Offset);
+        Ret->LabelID = NumEdgeLabels++;
         IndexEdgeLabelMap.insert(std::pair<long, DyckGraphEdgeLabel *>(Offset, Ret));
         return Ret;
     }
 }
 
+DyckGraphEdgeLabel *DyckGraph::getCollapsedEdgeLabel(DyckGraphEdgeLabel::LabelType Ty) {
+    if (Ty == DyckGraphEdgeLabel::LT_Offset) {
+        if (!CollapsedOffsetEdgeLabel)
+            CollapsedOffsetEdgeLabel = getOrInsertOffsetEdgeLabel(PointerOffsetEdgeLabel::AnyOffset);
+        return CollapsedOffsetEdgeLabel;
+    }
+    assert(Ty == DyckGraphEdgeLabel::LT_Index);
+    if (!CollapsedIndexEdgeLabel)
+        CollapsedIndexEdgeLabel = getOrInsertIndexEdgeLabel(FieldIndexEdgeLabel::AnyIndex);
+    return CollapsedIndexEdgeLabel;
+}
+
+bool DyckGraph::isCollapsed(DyckGraphNode *Src, DyckGraphEdgeLabel::LabelType Ty) const {
+    auto *Collapsed = Ty == DyckGraphEdgeLabel::LT_Offset ? CollapsedOffsetEdgeLabel : CollapsedIndexEdgeLabel;
+    return Collapsed && Src->outNumVertices(Collapsed);
+}
+
+bool DyckGraph::exceedsFieldLimits(DyckGraphNode *Src, DyckGraphEdgeLabel::LabelType Ty, const long *Field) const {
+    // a vertex with a wildcard edge is collapsed whatever its summary says
+    if (isCollapsed(Src, Ty)) return true;
+    DyckFieldSummary Fields = Src->getFieldSummary(Ty);
+    if (Field) Fields.add(*Field);
+    if (MaxFields && Fields.NumFields > MaxFields) return true;
+    return FieldStride && Fields.NumFields >= FieldStride && Fields.isEvenlySpaced();
+}
+
+DyckGraphEdgeLabel *DyckGraph::getOrInsertFieldEdgeLabel(DyckGraphNode *Src, DyckGraphEdgeLabel::LabelType Ty,
+                                                         long Field) {
+    bool IsOffset = Ty == DyckGraphEdgeLabel::LT_Offset;
+    long AnyField = IsOffset ? PointerOffsetEdgeLabel::AnyOffset : FieldIndexEdgeLabel::AnyIndex;
+    bool Collapsed = isCollapsed(Src, Ty);
+    if (Field != AnyField && !Collapsed) {
+        auto *Label = IsOffset ? getOrInsertOffsetEdgeLabel(Field) : getOrInsertIndexEdgeLabel(Field);
+        if (Src->outNumVertices(Label) || !exceedsFieldLimits(Src, Ty, &Field)) return Label;
+    }
+    if (!Collapsed) ++NumCollapsedVertices;
+    // the edges added since the vertex was collapsed, e.g., from a vertex merged into it, are collapsed as well
+    collapseEdges(Src, Ty);
+    return getCollapsedEdgeLabel(Ty);
+}
+
+void DyckGraph::collapseEdges(DyckGraphNode *Src, DyckGraphEdgeLabel::LabelType Ty) {
+    auto *Collapsed = getCollapsedEdgeLabel(Ty);
+    // adding a target of the collapsed label may insert it into the edge map, so collect the edges first
+    std::vector<std::pair<DyckGraphEdgeLabel *, DyckGraphNode *>> Edges;
+    for (auto &Out: Src->getOutVertices()) {
+        if (Out.first == Collapsed || !Out.first->isLabelTy(Ty)) continue;
+        for (auto *Target: Out.second) Edges.emplace_back(Out.first, Target);
+    }
+    for (auto &Edge: Edges) {
+        Src->addTarget(Edge.second, Collapsed);
+        Src->removeTarget(Edge.second, Edge.first);
+        Pending.remove(Src->getIndex(), Edge.first);
+    }
+}
+
 void DyckGraph::printAsDot(const char *FileName) const {
     FILE *FileDesc = fopen(FileName, "w+");
     fprintf(FileDesc, "digraph ptg {\n");
 
-    auto VIt = Vertices.begin();
-    while (VIt != Vertices.end()) {
+    auto VRange = getVertices();
+    auto VIt = VRange.begin();
+    while (VIt != VRange.end()) {
         if ((*VIt)->getName() != nullptr)
             fprintf(FileDesc, "\ta%d[label=\"%s\"];\n", (*VIt)->getIndex(), (*VIt)->getName());
         else
             fprintf(FileDesc, "\ta%d;\n", (*VIt)->getIndex());
 
-        std::map<DyckGraphEdgeLabel *, std::set<DyckGraphNode *>> &Outs = (*VIt)->getOutVertices();
+        DyckGraphEdgeMap &Outs = (*VIt)->getOutVertices();
         auto OIt = Outs.begin();
         while (OIt != Outs.end()) {
             long Label = (long) (OIt->first);
-            std::set<DyckGraphNode *> *Tars = &OIt->second;
+            DyckGraphNodeSet *Tars = &OIt->second;
             auto TarIt = Tars->begin();
             while (TarIt != Tars->end()) {
                 fprintf(FileDesc, "\ta%d->a%d [label=\"%ld\"];\n", (*VIt)->getIndex(), (*TarIt)->getIndex(), Label);
@@ -96,37 +158,9 @@ void DyckGraph::printAsDot(const char *FileName) const {
     fclose(FileDesc);
 }
 
-void DyckGraph::removeFromWorkList(std::multimap<DyckGraphNode *, DyckGraphEdgeLabel *> &List, DyckGraphNode *Node, DyckGraphEdgeLabel *Label) {
-    typedef std::multimap<DyckGraphNode *, DyckGraphEdgeLabel *>::iterator CIT;
-    typedef std::pair<CIT, CIT> Range;
-    Range NodeRange = List.equal_range(Node);
-    auto Next = NodeRange.first;
-    while (Next != NodeRange.second) {
-        if ((Next)->second == Label) {
-            List.erase(Next);
-            return;
-        }
-        Next++;
-    }
-}
-
-bool DyckGraph::containsInWorkList(std::multimap<DyckGraphNode *, DyckGraphEdgeLabel *> &List, DyckGraphNode *v, DyckGraphEdgeLabel *l) {
-    typedef std::multimap<DyckGraphNode *, DyckGraphEdgeLabel *>::iterator CIT;
-    typedef std::pair<CIT, CIT> Range;
-    Range NodeRange = List.equal_range(v);
-    auto Next = NodeRange.first;
-    while (Next != NodeRange.second) {
-        if ((Next)->second == l) {
-            return true;
-        }
-        Next++;
-    }
-    return false;
-}
-
 DyckGraphNode *DyckGraph::combine(DyckGraphNode *NodeX, DyckGraphNode *NodeY) {
-    assert(Vertices.count(NodeX));
-    assert(Vertices.count(NodeY));
+    assert(getVertex(NodeX->getIndex()) == NodeX);
+    assert(getVertex(NodeY->getIndex()) == NodeY);
     if (NodeX == NodeY) return NodeX;
 
     // if(PrintCSourceFunctions && (NodeX->isAliasOfHeapAlloc() || NodeY->isAliasOfHeapAlloc())){
@@ -138,93 +172,22 @@ DyckGraphNode *DyckGraph::combine(DyckGraphNode *NodeX, DyckGraphNode *NodeY) {
         NodeX = NodeY;
         NodeY = Temp;
     }
-
-    std::set<DyckGraphEdgeLabel *> &YOutLabels = NodeY->getOutLabels();
-    auto YOIt = YOutLabels.begin();
-    while (YOIt != YOutLabels.end()) {
-        if (NodeY->containsTarget(NodeY, *YOIt)) {
-            if (!NodeX->containsTarget(NodeX, *YOIt)) {
-                NodeX->addTarget(NodeX, *YOIt);
-            }
-            NodeY->removeTarget(NodeY, *YOIt);
-
-        }
-        YOIt++;
-    }
-
-    YOIt = YOutLabels.begin();
-    while (YOIt != YOutLabels.end()) {
-        std::set<DyckGraphNode *> *Ws = &NodeY->getOutVertices()[*YOIt];
-        auto W = Ws->begin();
-        while (W != Ws->end()) {
-            if (!NodeX->containsTarget(*W, *YOIt)) {
-                NodeX->addTarget(*W, *YOIt);
-            }
-            // cannot use removeTarget function, which will affect iterator
-            // y remove target *w
-            DyckGraphNode *WTemp = *W;
-            Ws->erase(W++);
-            // *w remove src y
-            ((WTemp)->getInVertices())[*YOIt].erase(NodeY);
-        }
-        YOIt++;
-    }
-
-    std::set<DyckGraphEdgeLabel *> &YInLabels = NodeY->getInLabels();
-    auto YIIt = YInLabels.begin();
-    while (YIIt != YInLabels.end()) {
-        std::set<DyckGraphNode *> *Ws = &NodeY->getInVertices()[*YIIt];
-        auto W = Ws->begin();
-        while (W != Ws->end()) {
-            if (!(*W)->containsTarget(NodeX, *YIIt)) {
-                (*W)->addTarget(NodeX, *YIIt);
-            }
-
-            // cannot use removeTarget function, which will affect iterator
-            DyckGraphNode *WTemp = *W;
-            Ws->erase(W++);
-            ((WTemp)->getOutVertices())[*YIIt].erase(NodeY);
-        }
-
-        YIIt++;
-    }
-    auto Vals = NodeY->getEquivalentSet();
-    for (auto &Val: *Vals) {
-        ValVertexMap[Val] = NodeX;
-    }
-    NodeY->mvEquivalentSetTo(NodeX);
-    Vertices.erase(NodeY);
-    delete NodeY;
+    mergeVertices(NodeX, NodeY);
     return NodeX;
 }
 
 bool DyckGraph::qirunAlgorithm() {
     bool Ret = true;
-    std::multimap<DyckGraphNode *, DyckGraphEdgeLabel *> Worklist;
-    auto VIt = Vertices.begin();
-    while (VIt != Vertices.end()) {
-        std::set<DyckGraphEdgeLabel *> &OutLabels = (*VIt)->getOutLabels();
-        auto LabelIt = OutLabels.begin();
-        while (LabelIt != OutLabels.end()) {
-            if ((*VIt)->outNumVertices(*LabelIt) > 1) {
-                Worklist.insert(std::pair<DyckGraphNode *, DyckGraphEdgeLabel *>(*VIt, *LabelIt));
-            }
-            LabelIt++;
-        }
-        VIt++;
-    }
+    if (!Pending.empty()) Ret = false;
 
-    if (!Worklist.empty()) Ret = false;
-
-    while (!Worklist.empty()) {
-        //outs()<<"HERE0\n"; outs().flush();
-        auto ZIt = Worklist.begin();
-        //outs()<<"HERE0.1\n"; outs().flush();
-        std::set<DyckGraphNode *> *Nodes = &ZIt->first->getOutVertices()[ZIt->second];
+    while (!Pending.empty()) {
+        auto Z = Pending.front();
+        assert(Vertices[Z.first]);
+        DyckGraphNodeSet *Nodes = Vertices[Z.first]->getOutVertices(Z.second);
+        assert(Nodes && Nodes->size() > 1);
         auto NodeIt = Nodes->begin();
         DyckGraphNode *X = *(NodeIt);
         NodeIt++;
-        //outs()<<"HERE0.2\n"; outs().flush();
         DyckGraphNode *Y = *(NodeIt);
         if (X->degree() < Y->degree()) {
             DyckGraphNode *Temp = X;
@@ -235,102 +198,102 @@ bool DyckGraph::qirunAlgorithm() {
         //     X->setAliasOfHeapAlloc();
         //     Y->setAliasOfHeapAlloc();
         // }
-        //outs()<<"HERE0.3\n"; outs().flush();
         assert(X != Y);
-        Vertices.erase(Y);
-        auto Vals = Y->getEquivalentSet();
-        for (auto &Val: *Vals) {
-            ValVertexMap[Val] = X;
+        mergeVertices(X, Y);
+    }
+    // the analysis results are queried by parallel clients, whose lookups must not write
+    Classes.flatten();
+    return Ret;
+}
+
+void DyckGraph::mergeVertices(DyckGraphNode *X, DyckGraphNode *Y) {
+    // a new pair with more than one target is added to the pending list by DyckGraphNode::addTarget,
+    // here we only remove the pairs that no longer have more than one target
+    for (auto &YOut: Y->getOutVertices()) {
+        DyckGraphEdgeLabel *Label = YOut.first;
+        if (Y->containsTarget(Y, Label)) {
+            X->addTarget(X, Label);
+            Y->removeTarget(Y, Label);
         }
-        //outs()<<"HERE0.4\n"; outs().flush();
-        Y->mvEquivalentSetTo(X/*->getRepresentative()*/);
-        //outs()<<"HERE1\n"; outs().flush();
-        std::set<DyckGraphEdgeLabel *> &YOutLabels = Y->getOutLabels();
-        auto YOIt = YOutLabels.begin();
-        while (YOIt != YOutLabels.end()) {
-            if (Y->containsTarget(Y, *YOIt)) {
-                if (!X->containsTarget(X, *YOIt)) {
-                    X->addTarget(X, *YOIt);
-                    if (X->outNumVertices(*YOIt) > 1 && !containsInWorkList(Worklist, X, *YOIt)) {
-                        Worklist.insert(std::pair<DyckGraphNode *, DyckGraphEdgeLabel *>(X, *YOIt));
-                    }
-                }
-                Y->removeTarget(Y, *YOIt);
-                if (Y->outNumVertices(*YOIt) < 2) {
-                    removeFromWorkList(Worklist, Y, *YOIt);
-                }
-            }
-            YOIt++;
+    }
+
+    for (auto &YOut: Y->getOutVertices()) {
+        DyckGraphEdgeLabel *Label = YOut.first;
+        // take over the targets so that the loop is not affected by removing edges
+        DyckGraphNodeSet Ws;
+        Ws.swap(YOut.second);
+        for (auto *W: Ws) {
+            X->addTarget(W, Label);
+            // *w remove src y
+            W->getInVertices()[Label].erase(Y);
         }
-        //outs()<<"HERE2\n"; outs().flush();
-        YOIt = YOutLabels.begin();
-        while (YOIt != YOutLabels.end()) {
-            std::set<DyckGraphNode *> *Ws = &Y->getOutVertices()[*YOIt];
-            auto W = Ws->begin();
-            while (W != Ws->end()) {
-                if (!X->containsTarget(*W, *YOIt)) {
-                    X->addTarget(*W, *YOIt);
-                    if (X->outNumVertices(*YOIt) > 1 && !containsInWorkList(Worklist, X, *YOIt)) {
-                        Worklist.insert(std::pair<DyckGraphNode *, DyckGraphEdgeLabel *>(X, *YOIt));
-                    }
-                }
-                // cannot use removeTarget function, which will affect iterator
-                // y remove target *w
-                DyckGraphNode *WTemp = *W;
-                Ws->erase(W++);
-                // *w remove src y
-                ((WTemp)->getInVertices())[*YOIt].erase(Y);
-                if (Y->outNumVertices(*YOIt) < 2) {
-                    removeFromWorkList(Worklist, Y, *YOIt);
-                }
+        Pending.remove(Y->getIndex(), Label);
+    }
+
+    for (auto &YIn: Y->getInVertices()) {
+        DyckGraphEdgeLabel *Label = YIn.first;
+        DyckGraphNodeSet Ws;
+        Ws.swap(YIn.second);
+        for (auto *W: Ws) {
+            W->getOutVertices()[Label].erase(Y);
+            W->addTarget(X, Label);
+            if (W->outNumVertices(Label) < 2) {
+                Pending.remove(W->getIndex(), Label);
             }
-            YOIt++;
         }
-        //outs()<<"HERE3\n"; outs().flush();
-        std::set<DyckGraphEdgeLabel *> &YInLabels = Y->getInLabels();
-        auto YIIt = YInLabels.begin();
-        while (YIIt != YInLabels.end()) {
-            std::set<DyckGraphNode *> *Ws = &Y->getInVertices()[*YIIt];
-            auto W = Ws->begin();
-            while (W != Ws->end()) {
-                if (!(*W)->containsTarget(X, *YIIt)) {
-                    (*W)->addTarget(X, *YIIt);
-                }
-
-                // cannot use removeTarget function, which will affect iterator
-                DyckGraphNode *WTemp = *W;
-                Ws->erase(W++);
-                ((WTemp)->getOutVertices())[*YIIt].erase(Y);
-                if ((WTemp)->outNumVertices(*YIIt) < 2) {
-                    removeFromWorkList(Worklist, WTemp, *YIIt);
-                }
-            }
+    }
 
-            YIIt++;
+    if (UnionFindReps) {
+        Classes.link(X->getIndex(), Y->getIndex());
+    } else {
+        for (auto *Val: Y->getEquivalentValues()) {
+            ValVertexMap[Val] = X->getIndex();
         }
-        delete Y;
     }
-    return Ret;
+    Y->mvEquivalentSetTo(X);
+    Vertices[Y->getIndex()] = nullptr;
+    --NumLiveVertices;
+    Y->~DyckGraphNode();
+
+    // x keeps its fields collapsed after taking over the fields of y, and may have too many fields now
+    for (auto Ty: {DyckGraphEdgeLabel::LT_Offset, DyckGraphEdgeLabel::LT_Index}) {
+        if (isCollapsed(X, Ty)) {
+            collapseEdges(X, Ty);
+        } else if (exceedsFieldLimits(X, Ty, nullptr)) {
+            ++NumCollapsedVertices;
+            collapseEdges(X, Ty);
+        }
+    }
+}
+
+DyckGraphNode *DyckGraph::getRepVertex(unsigned Index) {
+    if (UnionFindReps) Index = Classes.findSet(Index);
+    assert(Vertices[Index]);
+    return Vertices[Index];
 }
 
 std::pair<DyckGraphNode *, bool> DyckGraph::retrieveDyckVertex(llvm::Value *Val, const char *Name) {
     if (Val == nullptr) { 
-        auto *Node = new DyckGraphNode(nullptr);
-        Vertices.insert(Node);
+        auto *Node = new (Allocator.Allocate<DyckGraphNode>())
+                DyckGraphNode(this, nullptr, (int) Classes.makeSet());
+        Vertices.push_back(Node);
+        ++NumLiveVertices;
         return std::make_pair(Node, false);
     }
 
     auto It = ValVertexMap.find(Val);
     if (It != ValVertexMap.end()) {
-        return std::make_pair(It->second, true);
+        return std::make_pair(getRepVertex(It->second), true);
     } else {
-        auto *Node = new DyckGraphNode(Val, Name);
+        auto *Node = new (Allocator.Allocate<DyckGraphNode>())
+                DyckGraphNode(this, Val, (int) Classes.makeSet(), Name);
         if(isa<llvm::Instruction>(Val) && API::isHeapAllocate((llvm::Instruction *)Val)){
             // outs() << *Val << "\n";
             Node->setAliasOfHeapAlloc();
         }
-        Vertices.insert(Node);
-        ValVertexMap.insert(std::pair<llvm::Value *, DyckGraphNode *>(Val, Node));
+        Vertices.push_back(Node);
+        ++NumLiveVertices;
+        ValVertexMap.insert(std::pair<llvm::Value *, unsigned>(Val, Node->getIndex()));
         return std::make_pair(Node, false);
     }
 }
@@ -338,66 +301,127 @@ std::pair<DyckGraphNode *, bool> DyckGraph::retrieveDyckVertex(llvm::Value *Val,
 DyckGraphNode *DyckGraph::findDyckVertex(llvm::Value *Val) {
     auto It = ValVertexMap.find(Val);
     if (It != ValVertexMap.end()) {
-        return It->second;
+        return getRepVertex(It->second);
     }
     return nullptr;
 }
 
+void DyckGraph::substituteDyckVertex(llvm::Value *Val, DyckGraphNode *Node) {
+    assert(Val && !ValVertexMap.count(Val) && getVertex(Node->getIndex()) == Node);
+    ValVertexMap.insert(std::pair<llvm::Value *, unsigned>(Val, Node->getIndex()));
+    Node->addEquivalentValue(Val);
+}
+
 unsigned int DyckGraph::numVertices() {
-    return Vertices.size();
+    return NumLiveVertices;
 }
 
 unsigned int DyckGraph::numEquivalentClasses() {
-    return Vertices.size();
+    return NumLiveVertices;
 }
 
-std::set<DyckGraphNode *> &DyckGraph::getVertices() {
-    return Vertices;
+llvm::iterator_range<DyckGraphNodeIterator> DyckGraph::getVertices() const {
+    return {DyckGraphNodeIterator(Vertices.begin(), Vertices.end()),
+            DyckGraphNodeIterator(Vertices.end(), Vertices.end())};
 }
 
 void DyckGraph::validation(const char *File, int Line) {
     printf("Start validation... ");
-    std::set<DyckGraphNode *> &Reps = this->getVertices();
+    auto Reps = this->getVertices();
     auto RepsIt = Reps.begin();
     while (RepsIt != Reps.end()) {
         DyckGraphNode *Rep = *RepsIt;
-        auto RepVal = Rep->getEquivalentSet();
-        for (auto Val: *RepVal)
-            assert(ValVertexMap[Val] == Rep);
+        for (auto *Val: Rep->getEquivalentValues())
+            assert(findDyckVertex(Val) == Rep);
         RepsIt++;
     }
     printf("Done!\n\n");
 }
 
+namespace {
+/// the scratch buffer of the traversals of a thread, which is left clear after each traversal
+struct ReachableScratch {
+    llvm::BitVector Visited;
+    std::vector<DyckGraphNode *> Stack;
+};
+} // namespace
+
+static thread_local ReachableScratch Scratch;
+
 void DyckGraph::getReachableVertices(const std::set<DyckGraphNode *> &Sources, std::set<DyckGraphNode *> &Reachable) {
-    std::stack<DyckGraphNode *> WorkStack;
-    for (auto *N: Sources) if (N) WorkStack.push(N);
-    std::set<DyckGraphNode *> Visited;
-    while (!WorkStack.empty()) {
-        DyckGraphNode *Top = WorkStack.top();
-        WorkStack.pop();
-        if (Visited.count(Top)) continue;
-        Visited.insert(Top);
-
-        std::set<DyckGraphNode *> Tars;
-        for(auto label_map_node:Top->getOutVertices()){
-            Tars.insert(label_map_node.second.begin(), label_map_node.second.end());
-        }
-        // Top->getOutVertices(&Tars);
-        auto TIt = Tars.begin();
-        while (TIt != Tars.end()) {
-            DyckGraphNode *DGN = (*TIt);
-            if (Visited.find(DGN) == Visited.end())
-                WorkStack.push(DGN);
-            TIt++;
-        }
-    }
+    std::vector<DyckGraphNode *> Srcs(Sources.begin(), Sources.end());
+    std::vector<DyckGraphNode *> Visited;
+    getReachableVertices(Srcs, Visited);
     Reachable.insert(Visited.begin(), Visited.end());
 }
 
 void DyckGraph::getReachableVertices(DyckGraphNode *Source, std::set<DyckGraphNode *> &Reachable) {
     if (!Source) return;
-    std::set<DyckGraphNode *> Srcs;
-    Srcs.insert(Source);
-    getReachableVertices(Srcs, Reachable);
+    std::vector<DyckGraphNode *> Visited;
+    getReachableVertices(llvm::makeArrayRef(Source), Visited);
+    Reachable.insert(Visited.begin(), Visited.end());
+}
+
+void DyckGraph::getReachableVertices(llvm::ArrayRef<DyckGraphNode *> Sources, std::vector<DyckGraphNode *> &Reachable) {
+    auto &Visited = Scratch.Visited;
+    auto &Stack = Scratch.Stack;
+    if (Visited.size() < Vertices.size()) Visited.resize(Vertices.size());
+    bool Memoized = HasClosures.load(std::memory_order_acquire);
+
+    size_t Begin = Reachable.size();
+    auto Visit = [&Visited, &Reachable](DyckGraphNode *N) {
+        if (Visited.test(N->getIndex())) return false;
+        Visited.set(N->getIndex());
+        Reachable.push_back(N);
+        return true;
+    };
+    for (auto *N: Sources) if (N && Visit(N)) Stack.push_back(N);
+    while (!Stack.empty()) {
+        DyckGraphNode *Top = Stack.back();
+        Stack.pop_back();
+        // a memoized closure already contains everything reachable from the vertex
+        if (Memoized && Top->getIndex() < NumClosureSlots) {
+            if (auto *Closure = Closures[Top->getIndex()].load(std::memory_order_acquire)) {
+                for (auto *N: *Closure) Visit(N);
+                continue;
+            }
+        }
+        for (auto &Out: Top->getOutVertices()) {
+            for (auto *Target: Out.second) if (Visit(Target)) Stack.push_back(Target);
+        }
+    }
+    for (size_t K = Begin; K < Reachable.size(); ++K) Visited.reset(Reachable[K]->getIndex());
+}
+
+const std::vector<DyckGraphNode *> &DyckGraph::getReachableClosure(DyckGraphNode *Source) {
+    if (!HasClosures.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> Lock(ClosureMutex);
+        if (!HasClosures.load(std::memory_order_relaxed)) {
+            NumClosureSlots = Vertices.size();
+            Closures.reset(new std::atomic<const std::vector<DyckGraphNode *> *>[NumClosureSlots]());
+            HasClosures.store(true, std::memory_order_release);
+        }
+    }
+    assert(Source->getIndex() < NumClosureSlots);
+    auto &Slot = Closures[Source->getIndex()];
+    if (auto *Closure = Slot.load(std::memory_order_acquire)) return *Closure;
+
+    auto *Closure = new std::vector<DyckGraphNode *>;
+    getReachableVertices(llvm::makeArrayRef(Source), *Closure);
+    Closure->shrink_to_fit();
+    // another thread may have computed the same closure in the meantime
+    const std::vector<DyckGraphNode *> *Expected = nullptr;
+    if (!Slot.compare_exchange_strong(Expected, Closure, std::memory_order_acq_rel)) {
+        delete Closure;
+        return *Expected;
+    }
+    return *Closure;
+}
+
+void DyckGraph::clearReachableClosures() {
+    if (!HasClosures.load(std::memory_order_acquire)) return;
+    for (unsigned K = 0; K < NumClosureSlots; ++K) delete Closures[K].load(std::memory_order_relaxed);
+    Closures.reset();
+    NumClosureSlots = 0;
+    HasClosures.store(false, std::memory_order_release);
 }
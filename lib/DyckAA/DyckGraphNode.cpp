@@ -16,18 +16,20 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "DyckAA/DyckGraph.h"
 #include "DyckAA/DyckGraphNode.h"
 #include "DyckAA/DyckGraphEdgeLabel.h"
 
-int DyckGraphNode::GlobalNodeIndex = 0;
-
-DyckGraphNode::DyckGraphNode(llvm::Value *V, const char *Name) {
+DyckGraphNode::DyckGraphNode(DyckGraph *G, llvm::Value *V, int Index, const char *Name) {
+    Graph = G;
     NodeName = Name;
-    NodeIndex = GlobalNodeIndex++;
-    if (V) EquivClass.insert(V);
+    NodeIndex = Index;
+    if (V) EquivClass.push_back(V, G->Allocator);
 }
 
-DyckGraphNode::~DyckGraphNode() = default;
+DyckGraphNode::~DyckGraphNode() {
+    delete EquivSet.load(std::memory_order_relaxed);
+}
 
 const char *DyckGraphNode::getName() {
     return NodeName;
@@ -51,47 +53,39 @@ unsigned int DyckGraphNode::inNumVertices(DyckGraphEdgeLabel *Label) {
 
 unsigned int DyckGraphNode::degree() {
     unsigned int Ret = 0;
+    for (auto &InIt: InNodes) Ret = Ret + InIt.second.size();
+    for (auto &OutIt: OutNodes) Ret = Ret + OutIt.second.size();
+    return Ret;
+}
 
-    auto IIt = InNodes.begin();
-    while (IIt != InNodes.end()) {
-        Ret = Ret + IIt->second.size();
-        IIt++;
-    }
-
-    auto OIt = OutNodes.begin();
-    while (OIt != OutNodes.end()) {
-        Ret = Ret + OIt->second.size();
-        OIt++;
+const std::set<llvm::Value *> *DyckGraphNode::getEquivalentSet() const {
+    if (auto *Set = EquivSet.load(std::memory_order_acquire)) return Set;
+    auto *Set = new std::set<llvm::Value *>(EquivClass.begin(), EquivClass.end());
+    // another thread may have built the same set in the meantime
+    std::set<llvm::Value *> *Expected = nullptr;
+    if (!EquivSet.compare_exchange_strong(Expected, Set, std::memory_order_acq_rel)) {
+        delete Set;
+        return Expected;
     }
-
-    return Ret;
+    return Set;
 }
 
-std::set<llvm::Value *> *DyckGraphNode::getEquivalentSet() {
-    return &this->EquivClass;
+void DyckGraphNode::addEquivalentValue(llvm::Value *V) {
+    EquivClass.push_back(V, Graph->Allocator);
+    delete EquivSet.exchange(nullptr, std::memory_order_relaxed);
 }
 
 void DyckGraphNode::mvEquivalentSetTo(DyckGraphNode *RootRep) {
     if (RootRep == this) return;
-
-    std::set<llvm::Value *> *RootEC = RootRep->getEquivalentSet();
-    std::set<llvm::Value *> *ThisEC = this->getEquivalentSet();
-    RootEC->insert(ThisEC->begin(), ThisEC->end());
-}
-
-std::set<DyckGraphEdgeLabel *> &DyckGraphNode::getOutLabels() {
-    return OutLables;
+    RootRep->EquivClass.splice(EquivClass);
+    delete RootRep->EquivSet.exchange(nullptr, std::memory_order_relaxed);
 }
 
-std::map<DyckGraphEdgeLabel *, std::set<DyckGraphNode *>> &DyckGraphNode::getOutVertices() {
+DyckGraphEdgeMap &DyckGraphNode::getOutVertices() {
     return OutNodes;
 }
 
-std::set<DyckGraphEdgeLabel *> &DyckGraphNode::getInLabels() {
-    return InLables;
-}
-
-std::map<DyckGraphEdgeLabel *, std::set<DyckGraphNode *>> &DyckGraphNode::getInVertices() {
+DyckGraphEdgeMap &DyckGraphNode::getInVertices() {
     return InNodes;
 }
 
@@ -99,10 +93,24 @@ int DyckGraphNode::getIndex() const {
     return NodeIndex;
 }
 
-void DyckGraphNode::addTarget(DyckGraphNode *Node, DyckGraphEdgeLabel *Label) {
-    OutLables.insert(Label);
-    OutNodes[Label].insert(Node);
+bool DyckGraphNode::addTarget(DyckGraphNode *Node, DyckGraphEdgeLabel *Label) {
+    size_t NumLabels = OutNodes.size();
+    auto &Targets = OutNodes[Label];
+    // the labels of a vertex are never removed, so a new label is a new field if it is a field label
+    if (OutNodes.size() != NumLabels) {
+        if (Label->isLabelTy(DyckGraphEdgeLabel::LT_Offset)) {
+            long Offset = ((PointerOffsetEdgeLabel *) Label)->getOffsetBytes();
+            if (Offset != PointerOffsetEdgeLabel::AnyOffset) OffsetFields.add(Offset);
+        } else if (Label->isLabelTy(DyckGraphEdgeLabel::LT_Index)) {
+            long Index = ((FieldIndexEdgeLabel *) Label)->getFieldIndex();
+            if (Index != FieldIndexEdgeLabel::AnyIndex) IndexFields.add(Index);
+        }
+    }
+    if (!Targets.insert(Node)) return false;
+    // the targets are to be unified by qirun's algorithm
+    if (Targets.size() == 2) Graph->Pending.push(NodeIndex, Label);
     Node->addSource(this, Label);
+    return true;
 }
 
 void DyckGraphNode::removeTarget(DyckGraphNode *Node, DyckGraphEdgeLabel *Label) {
@@ -118,13 +126,13 @@ bool DyckGraphNode::containsTarget(DyckGraphNode *Tar, DyckGraphEdgeLabel *Label
     return false;
 }
 
-std::set<DyckGraphNode *> *DyckGraphNode::getInVertices(DyckGraphEdgeLabel *Label) {
+DyckGraphNodeSet *DyckGraphNode::getInVertices(DyckGraphEdgeLabel *Label) {
     auto It = InNodes.find(Label);
     if (It != InNodes.end()) return &It->second;
     return nullptr;
 }
 
-std::set<DyckGraphNode *> *DyckGraphNode::getOutVertices(DyckGraphEdgeLabel *Label) {
+DyckGraphNodeSet *DyckGraphNode::getOutVertices(DyckGraphEdgeLabel *Label) {
     auto It = OutNodes.find(Label);
     if (It != OutNodes.end()) return &It->second;
     return nullptr;
@@ -145,7 +153,6 @@ DyckGraphNode *DyckGraphNode::getOutVertex(DyckGraphEdgeLabel *Label) {
 // the followings are private functions
 
 void DyckGraphNode::addSource(DyckGraphNode *Node, DyckGraphEdgeLabel *Label) {
-    InLables.insert(Label);
     InNodes[Label].insert(Node);
 }
 
@@ -21,6 +21,7 @@
 #include "DyckAA/DyckGraph.h"
 #include "DyckAA/DyckGraphNode.h"
 #include "DyckAA/DyckModRefAnalysis.h"
+#include "ModuleNumbering.h"
 #include "Support/API.h"
 #include "Support/CFG.h"
 #include "Support/RecursiveTimer.h"
@@ -29,12 +30,16 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <cassert>
 #include <functional>
 #include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Instructions.h>
 #include <map>
+#include <memory>
 #include <vector>
 
 static std::map<Function *, std::map<DyckGraphNode *, std::vector<LoadInst *>>> FuncLoadMap;
@@ -48,24 +53,38 @@ static void collectInst(Function &F, DyckAliasAnalysis *DAA, DyckModRefAnalysis
 DyckVFG::DyckVFG(DyckAliasAnalysis *DAA, DyckModRefAnalysis *DMRA, Module *M) {
     // create a VFG for each function
     std::map<Function *, CFGRef> LocalCFGMap;
+    std::map<Function *, EdgeBufferTy> LocalEdgeMap;
     for (auto &F : *M) {
         if (F.empty())
             continue;
         LocalCFGMap[&F] = nullptr;
+        LocalEdgeMap[&F];
         buildLocalVFG(F);
         collectInst(F, DAA, DMRA);
     }
 
+    // the tasks only read the VFG and the maps above, and write their own slots
+    ThreadPool::TaskGroup Group;
     for (auto &F : *M) {
         if (F.empty())
             continue;
-        ThreadPool::get()->enqueue([this, DAA, &F, &LocalCFGMap]() {
+        ThreadPool::get()->enqueue(Group, [this, DAA, &F, &LocalCFGMap, &LocalEdgeMap]() {
             auto LocalCFG = std::make_shared<CFG>(&F);
             LocalCFGMap.at(&F) = LocalCFG;
-            buildLocalVFG(DAA, LocalCFG.get(), &F);
+            buildLocalVFG(DAA, LocalCFG.get(), &F, LocalEdgeMap.at(&F));
         });
     }
-    ThreadPool::get()->wait();
+    ThreadPool::get()->wait(Group);
+
+    // the edges may connect nodes shared by functions, e.g., globals, so they are added here in the order of functions
+    for (auto &F : *M) {
+        if (F.empty())
+            continue;
+        auto &Edges = LocalEdgeMap.at(&F);
+        for (auto &Edge : Edges)
+            addEdge(Edge.first, Edge.second);
+        EdgeBufferTy().swap(Edges);
+    }
 
     // connect local VFGs
     auto *DyckCG = DAA->getDyckCallGraph();
@@ -98,11 +117,23 @@ DyckVFG::DyckVFG(DyckAliasAnalysis *DAA, DyckModRefAnalysis *DMRA, Module *M) {
             }
         }
     }
+    freeze();
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# VFG nodes: " << numNodes() << "\n");
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# VFG edges: " << numEdges() << "\n");
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# VFG storage: "
+                                           << Nodes.capacity() * sizeof(DyckVFGNode) +
+                                              (OwnedOutEdges.capacity() + OwnedInEdges.capacity()) * sizeof(uint32_t)
+                                           << " bytes\n");
 }
 
 static void collectInst(Function &F, DyckAliasAnalysis *DAA, DyckModRefAnalysis *DMRA) {
 
     DyckGraph *DG = DAA->getDyckGraph();
+    // create the entries here, so that they are only looked up when building local VFGs in parallel
+    FuncLoadMap[&F];
+    FuncStoreMap[&F];
+    FuncInsertValueMap[&F];
+    FuncExtractValueMap[&F];
     for (auto &Inst : instructions(F)) {
         if (auto *Load = dyn_cast<LoadInst>(&Inst)) {
             auto *Ptr = Load->getPointerOperand();
@@ -137,7 +168,7 @@ void DyckVFG::buildLocalVFG(Function &F) {
             for (unsigned K = 0; K < I.getNumOperands(); ++K) {
                 auto *From = I.getOperand(K);
                 auto *FromNode = getOrCreateVFGNode(From);
-                FromNode->addTarget(ToNode);
+                addEdge(FromNode, ToNode);
             }
         }
         else if (isa<SelectInst>(I)) {
@@ -145,7 +176,7 @@ void DyckVFG::buildLocalVFG(Function &F) {
             for (unsigned K = 1; K < I.getNumOperands(); ++K) {
                 auto *From = I.getOperand(K);
                 auto *FromNode = getOrCreateVFGNode(From);
-                FromNode->addTarget(ToNode);
+                addEdge(FromNode, ToNode);
             }
         }
         else if (auto *GEP = dyn_cast<GetElementPtrInst>(&I)) {
@@ -165,7 +196,7 @@ void DyckVFG::buildLocalVFG(Function &F) {
             if (VF) {
                 auto *ToNode = getOrCreateVFGNode(&I);
                 auto *FromNode = getOrCreateVFGNode(GEP->getPointerOperand());
-                FromNode->addTarget(ToNode);
+                addEdge(FromNode, ToNode);
             }
         }
         else if (isa<LoadInst>(I)) {
@@ -197,13 +228,12 @@ void DyckVFG::buildLocalVFG(Function &F) {
     }
 }
 
-void DyckVFG::buildLocalVFG(DyckAliasAnalysis *DAA, CFG *CtrlFlow, Function *F) const {
+void DyckVFG::buildLocalVFG(DyckAliasAnalysis *DAA, CFG *CtrlFlow, Function *F, EdgeBufferTy &Edges) const {
     // indirect value flow through load/store
-    auto *DG = DAA->getDyckGraph();
-    std::map<DyckGraphNode *, std::vector<LoadInst *>> &LoadMap = FuncLoadMap[F];                         // ptr -> load
-    std::map<DyckGraphNode *, std::vector<StoreInst *>> &StoreMap = FuncStoreMap[F];                      // ptr -> store
-    std::map<DyckGraphNode *, std::vector<InsertValueInst *>> &InsertValueMap = FuncInsertValueMap[F];    // ptr -> InsertValue
-    std::map<DyckGraphNode *, std::vector<ExtractValueInst *>> &ExtractValueMap = FuncExtractValueMap[F]; // ptr -> ExtractValue
+    auto &LoadMap = FuncLoadMap.at(F);                   // ptr -> load
+    auto &StoreMap = FuncStoreMap.at(F);                 // ptr -> store
+    auto &InsertValueMap = FuncInsertValueMap.at(F);     // ptr -> InsertValue
+    auto &ExtractValueMap = FuncExtractValueMap.at(F);   // ptr -> ExtractValue
     // match load and store:
     // if alias(load's ptr, store's ptr) and store -> load in CFG, add store's value -> load's value in VFG
     for (auto &LoadIt : LoadMap) {
@@ -220,13 +250,13 @@ void DyckVFG::buildLocalVFG(DyckAliasAnalysis *DAA, CFG *CtrlFlow, Function *F)
                 if (CtrlFlow->reachable(Store, Load)) {
                     auto *StNode = getVFGNode(Store->getValueOperand());
                     assert(StNode);
-                    StNode->addTarget(LdNode);
+                    Edges.emplace_back(StNode, LdNode);
                 }
             }
         }
     }
 
-    for (auto ExtractValueIt : ExtractValueMap) {
+    for (auto &ExtractValueIt : ExtractValueMap) {
         DyckGraphNode *DNode = ExtractValueIt.first;
         auto &EVInstSet = ExtractValueIt.second;
         auto InsertValueIt = InsertValueMap.find(DNode);
@@ -254,7 +284,7 @@ void DyckVFG::buildLocalVFG(DyckAliasAnalysis *DAA, CFG *CtrlFlow, Function *F)
                     }
                     if (AllIdxEq || AllIdxZero) {
                         auto *InsertNode = getVFGNode(InsertValue->getInsertedValueOperand());
-                        InsertNode->addTarget(ExtractNode);
+                        Edges.emplace_back(InsertNode, ExtractNode);
                     }
                 }
             }
@@ -262,10 +292,7 @@ void DyckVFG::buildLocalVFG(DyckAliasAnalysis *DAA, CFG *CtrlFlow, Function *F)
     }
 }
 
-DyckVFG::~DyckVFG() {
-    for (auto &It : ValueNodeMap)
-        delete It.second;
-}
+DyckVFG::~DyckVFG() = default;
 
 DyckVFGNode *DyckVFG::getVFGNode(Value *V) const {
     auto It = ValueNodeMap.find(V);
@@ -277,27 +304,171 @@ DyckVFGNode *DyckVFG::getVFGNode(Value *V) const {
 DyckVFGNode *DyckVFG::getOrCreateVFGNode(Value *V) {
     auto It = ValueNodeMap.find(V);
     if (It == ValueNodeMap.end()) {
-        auto *Ret = new DyckVFGNode(V);
+        NodeChunks.emplace_back(V, NodeChunks.size());
+        auto *Ret = &NodeChunks.back();
         ValueNodeMap[V] = Ret;
         return Ret;
     }
     return It->second;
 }
 
+void DyckVFG::freeze() {
+    Nodes.reserve(NodeChunks.size());
+    for (auto &N : NodeChunks)
+        Nodes.push_back(N);
+    std::deque<DyckVFGNode>().swap(NodeChunks);
+    for (auto &N : Nodes)
+        ValueNodeMap[N.V] = &N;
+
+    // the same edge may be added more than once, e.g., a store reaching a load along different calls
+    std::sort(EdgeList.begin(), EdgeList.end());
+    EdgeList.erase(std::unique(EdgeList.begin(), EdgeList.end()), EdgeList.end());
+
+    // counting sort the edges by source and by target, which keeps the order of (source, target, label) in a row
+    std::vector<unsigned> OutStart(Nodes.size() + 1, 0), InStart(Nodes.size() + 1, 0);
+    for (auto &E : EdgeList) {
+        ++OutStart[std::get<0>(E) + 1];
+        ++InStart[std::get<1>(E) + 1];
+    }
+    for (unsigned K = 0; K < Nodes.size(); ++K) {
+        OutStart[K + 1] += OutStart[K];
+        InStart[K + 1] += InStart[K];
+    }
+    OwnedOutEdges.resize(EdgeList.size() * 2);
+    OwnedInEdges.resize(EdgeList.size() * 2);
+    std::vector<unsigned> OutPos(OutStart.begin(), OutStart.end() - 1), InPos(InStart.begin(), InStart.end() - 1);
+    for (auto &E : EdgeList) {
+        unsigned Src = std::get<0>(E), Dst = std::get<1>(E);
+        auto L = (uint32_t)std::get<2>(E);
+        unsigned Out = 2 * OutPos[Src]++, In = 2 * InPos[Dst]++;
+        OwnedOutEdges[Out] = Dst;
+        OwnedOutEdges[Out + 1] = L;
+        OwnedInEdges[In] = Src;
+        OwnedInEdges[In + 1] = L;
+    }
+    EdgeListTy().swap(EdgeList);
+    OutEdges = OwnedOutEdges;
+    InEdges = OwnedInEdges;
+
+    for (unsigned K = 0; K < Nodes.size(); ++K) {
+        auto &N = Nodes[K];
+        N.OutBegin = OutEdges.data() + 2 * OutStart[K];
+        N.OutEnd = OutEdges.data() + 2 * OutStart[K + 1];
+        N.InBegin = InEdges.data() + 2 * InStart[K];
+        N.InEnd = InEdges.data() + 2 * InStart[K + 1];
+    }
+}
+
+/// The file is a stream of little-endian 32-bit words:
+///   magic, version, the hash of the module's bitcode (4 words), the number of values in the module numbering,
+///   the number of nodes N, the number of edges E,
+///   the number of the value of each node (N words),
+///   the out-going edges: the start of each node's row (N + 1 words), and (target, label) of each edge (2E words),
+///   the incoming edges: the start of each node's row (N + 1 words), and (source, label) of each edge (2E words).
+/// Labels are stored as two's complement, i.e., 0 for epsilon, positive for calls, and negative for returns.
+static const uint32_t VFGMagic = 0x47465644; // "DVFG"
+static const uint32_t VFGVersion = 2;
+
+bool DyckVFG::save(StringRef Path, const ModuleNumbering &Numbering) const {
+    std::vector<uint32_t> Words;
+    Words.reserve(8 + Nodes.size() * 3 + OutEdges.size() * 2);
+    Words.push_back(VFGMagic);
+    Words.push_back(VFGVersion);
+    appendWords(Words, Numbering.getModuleHash());
+    Words.push_back(Numbering.size());
+    Words.push_back(Nodes.size());
+    Words.push_back(numEdges());
+
+    for (auto &N : Nodes) {
+        unsigned ID = Numbering.getID(N.V);
+        if (ID == ModuleNumbering::InvalidID)
+            return false;
+        Words.push_back(ID);
+    }
+
+    auto WriteRows = [this, &Words](ArrayRef<uint32_t> Edges, bool Out) {
+        for (auto &N : Nodes)
+            Words.push_back(((Out ? N.OutBegin : N.InBegin) - Edges.data()) / 2);
+        Words.push_back(Edges.size() / 2);
+        Words.insert(Words.end(), Edges.begin(), Edges.end());
+    };
+    WriteRows(OutEdges, true);
+    WriteRows(InEdges, false);
+    return writeNumberedFile(Path, Words);
+}
+
+DyckVFG *DyckVFG::load(StringRef Path, const ModuleNumbering &Numbering) {
+    // large files are memory-mapped
+    auto BufferOrErr = MemoryBuffer::getFile(Path, /* IsText */ false, /* RequiresNullTerminator */ false);
+    if (!BufferOrErr)
+        return nullptr;
+    NumberingReader R((*BufferOrErr)->getBuffer(), Numbering.values());
+
+    uint32_t Word, NumNodes, NumEdges;
+    MD5::MD5Result Hash;
+    if (!R.read(Word) || Word != VFGMagic || !R.read(Word) || Word != VFGVersion)
+        return nullptr;
+    if (!R.read(Hash) || !(Hash == Numbering.getModuleHash()))
+        return nullptr;
+    if (!R.read(Word) || Word != Numbering.size() || !R.read(NumNodes) || !R.read(NumEdges))
+        return nullptr;
+
+    std::unique_ptr<DyckVFG> VFG(new DyckVFG);
+    auto &Nodes = VFG->Nodes;
+    Nodes.reserve(NumNodes);
+    for (uint32_t K = 0; K < NumNodes; ++K) {
+        Value *V;
+        if (!R.read(V))
+            return nullptr;
+        Nodes.emplace_back(V, K);
+        if (!VFG->ValueNodeMap.emplace(V, &Nodes.back()).second)
+            return nullptr;
+    }
+
+    // the rows are used in place, so they are only checked here
+    auto ReadRows = [&R, &Nodes, NumNodes, NumEdges](ArrayRef<uint32_t> &Edges, std::vector<uint32_t> &Storage,
+                                                     bool Out) {
+        std::vector<uint32_t> Start(NumNodes + 1);
+        for (uint32_t K = 0; K <= NumNodes; ++K) {
+            if (!R.read(Start[K]) || Start[K] < (K ? Start[K - 1] : 0))
+                return false;
+        }
+        if (Start[NumNodes] != NumEdges || !R.read(Edges, 2 * (size_t)NumEdges, Storage))
+            return false;
+        for (size_t K = 0; K < Edges.size(); K += 2) {
+            if (Edges[K] >= NumNodes)
+                return false;
+        }
+        for (uint32_t K = 0; K < NumNodes; ++K) {
+            auto &N = Nodes[K];
+            (Out ? N.OutBegin : N.InBegin) = Edges.data() + 2 * (size_t)Start[K];
+            (Out ? N.OutEnd : N.InEnd) = Edges.data() + 2 * (size_t)Start[K + 1];
+        }
+        return true;
+    };
+    if (!ReadRows(VFG->OutEdges, VFG->OwnedOutEdges, true) || !ReadRows(VFG->InEdges, VFG->OwnedInEdges, false) ||
+        !R.atEnd())
+        return nullptr;
+    VFG->Buffer = std::move(*BufferOrErr);
+    return VFG.release();
+}
+
 static void collectValues(std::set<DyckGraphNode *>::iterator Begin, std::set<DyckGraphNode *>::iterator End,
                           std::vector<std::set<Value *>> &CallerVals, std::vector<std::set<Value *>> &CalleeVals, Call *C,
                           Function *Callee, CFG *Ctrl, bool RefOrMod) {
-    outs() << "Caller :\t" << C->getInstruction()->getFunction()->getName() << "\n";
-    outs() << "CallInst :\t" << *C->getInstruction() << "\n";
-    outs() << "Callee :\t" << Callee->getName() << "\n";
+    DEBUG_WITH_TYPE("dyckvfg-connect", {
+        outs() << "Caller :\t" << C->getInstruction()->getFunction()->getName() << "\n";
+        outs() << "CallInst :\t" << *C->getInstruction() << "\n";
+        outs() << "Callee :\t" << Callee->getName() << "\n";
+    });
     auto *Caller = C->getInstruction()->getFunction();
     for (auto It = Begin; It != End; ++It) {
         CalleeVals.emplace_back();
         CallerVals.emplace_back();
         auto *N = *It;
-        auto *ValSet = (std::set<Value *> *)N->getEquivalentSet();
-        for (auto *V : *ValSet) {
-            outs() << "Value: " << *V << "\n";
+        for (auto *V : N->getEquivalentValues()) {
+            // printing an instruction numbers its function, so the values are only dumped for debugging
+            DEBUG_WITH_TYPE("dyckvfg-connect", outs() << "Value: " << *V << "\n");
             if (auto *Arg = dyn_cast<Argument>(V)) {
                 if (Arg->getParent() == Callee)
                     CalleeVals.back().insert(Arg);
@@ -319,21 +490,23 @@ static void collectValues(std::set<DyckGraphNode *>::iterator Begin, std::set<Dy
             }
         }
     }
-    for (int i = 0; i < CalleeVals.size(); i++) {
-        outs() << "CalleeVals: ";
-        for (auto *V : CalleeVals[i]) {
-            outs() << *V << " ";
+    DEBUG_WITH_TYPE("dyckvfg-connect", {
+        for (int i = 0; i < CalleeVals.size(); i++) {
+            outs() << "CalleeVals: ";
+            for (auto *V : CalleeVals[i]) {
+                outs() << *V << " ";
+            }
+            outs() << "\n";
         }
-        outs() << "\n";
-    }
-    for (int i = 0; i < CallerVals.size(); i++) {
-        outs() << "CallerVals: ";
-        for (auto *V : CallerVals[i]) {
-            outs() << *V << "\n";
+        for (int i = 0; i < CallerVals.size(); i++) {
+            outs() << "CallerVals: ";
+            for (auto *V : CallerVals[i]) {
+                outs() << *V << "\n";
+            }
+            outs() << "\n";
         }
         outs() << "\n";
-    }
-    outs() << "\n";
+    });
 }
 
 void DyckVFG::connectInsertExtractIndirectFlow(std::map<DyckGraphNode *, std::vector<ExtractValueInst *>> ExtractValueMap,
@@ -368,7 +541,7 @@ void DyckVFG::connectInsertExtractIndirectFlow(std::map<DyckGraphNode *, std::ve
                     }
                     if (AllIdxEq || AllIdxZero) {
                         auto *InsertNode = getVFGNode(InsertValue->getInsertedValueOperand());
-                        InsertNode->addTarget(ExtractNode, CallId);
+                        addEdge(InsertNode, ExtractNode, CallId);
                     }
                 }
             }
@@ -385,7 +558,7 @@ void DyckVFG::connect(DyckAliasAnalysis *DAA, DyckModRefAnalysis *DMRA, Call *C,
         auto *ActualNode = getOrCreateVFGNode(Actual);
         auto *Formal = Callee->getArg(K);
         auto *FormalNode = getOrCreateVFGNode(Formal);
-        ActualNode->addTarget(FormalNode, C->id());
+        addEdge(ActualNode, FormalNode, C->id());
     }
     // connect direct outputs
     if (!C->getInstruction()->getType()->isVoidTy()) {
@@ -397,7 +570,7 @@ void DyckVFG::connect(DyckAliasAnalysis *DAA, DyckModRefAnalysis *DMRA, Call *C,
             if (RetInst->getNumOperands() != 1)
                 continue;
             auto *FormalRet = getOrCreateVFGNode(Inst.getOperand(0));
-            FormalRet->addTarget(ActualRet, -C->id());
+            addEdge(FormalRet, ActualRet, -C->id());
         }
     }
     // if this function does not contain any basicblock
@@ -416,13 +589,14 @@ void DyckVFG::connect(DyckAliasAnalysis *DAA, DyckModRefAnalysis *DMRA, Call *C,
     for (int i = 0; i < RefCalleeValues.size(); i++)
         for (auto *CallerVal : RefCallerValues[i])
             for (auto *CalleeVal : RefCalleeValues[i])
-                getOrCreateVFGNode(CallerVal)->addTarget(getOrCreateVFGNode(CalleeVal), C->id());
+                addEdge(getOrCreateVFGNode(CallerVal), getOrCreateVFGNode(CalleeVal), C->id());
 
     // connect indirect outputs
     //  1. get mods, get mod values (in caller and callee)
     //  2. connect ref values (callee) -> ref values (caller)
-    outs() << "Connect indirect outputs in " << C->getInstruction()->getFunction()->getName() << " to " << Callee->getName()
-           << "\n";
+    DEBUG_WITH_TYPE("dyckvfg-connect", outs() << "Connect indirect outputs in "
+                                              << C->getInstruction()->getFunction()->getName() << " to "
+                                              << Callee->getName() << "\n");
     // for(auto ValueIt = DMRA->mod_begin(Callee); ValueIt != DMRA->mod_end(Callee); ValueIt ++){
     //     outs() << "Value: " << (*ValueIt)->getEquivalentSet() << "\n";
     // }
@@ -431,7 +605,7 @@ void DyckVFG::connect(DyckAliasAnalysis *DAA, DyckModRefAnalysis *DMRA, Call *C,
     for (int i = 0; i < ModCalleeValues.size(); i++)
         for (auto *CalleeVal : ModCalleeValues[i])
             for (auto *CallerVal : ModCallerValues[i])
-                getOrCreateVFGNode(CalleeVal)->addTarget(getOrCreateVFGNode(CallerVal), -C->id());
+                addEdge(getOrCreateVFGNode(CalleeVal), getOrCreateVFGNode(CallerVal), -C->id());
     // connect indirect inputs through field accesses
     auto I2CallSite = [&C, &Ctrl](Instruction *I, Instruction *E) -> bool { return Ctrl->reachable(I, C->getInstruction()); };
 
@@ -19,9 +19,17 @@
 #include "DyckAA/DyckAliasAnalysis.h"
 #include "DyckAA/DyckModRefAnalysis.h"
 #include "DyckAA/DyckValueFlowAnalysis.h"
+#include "ModuleNumbering.h"
 #include "Support/RecursiveTimer.h"
 #include <iostream>
 
+static cl::opt<std::string> ExportVFG("dyckvfg-export", cl::value_desc("filename"), cl::Hidden,
+                                      cl::desc("Write the value flow graph into a binary file."));
+
+static cl::opt<std::string> ImportVFG("dyckvfg-import", cl::value_desc("filename"), cl::Hidden,
+                                      cl::desc("Load the value flow graph from a binary file written by "
+                                               "-dyckvfg-export for the same module, instead of building it."));
+
 char DyckValueFlowAnalysis::ID = 0;
 static RegisterPass<DyckValueFlowAnalysis> X("dyckvfa", "vfa based on the unification based alias analysis");
 
@@ -50,6 +58,19 @@ bool DyckValueFlowAnalysis::runOnModule(Module &M) {
     // if(DyckAA->analysisC){
     //   return false;
     // }
-    VFG = new DyckVFG(DyckAA, DyckMRA, &M);
+    if (!ImportVFG.empty()) {
+        RecursiveTimer LoadTimer("Loading DyckVFG");
+        VFG = DyckVFG::load(ImportVFG, DyckAA->getModuleNumbering());
+        if (!VFG)
+            errs() << "Warning: " << ImportVFG << " does not match the module, rebuilding the value flow graph\n";
+    }
+    if (!VFG)
+        VFG = new DyckVFG(DyckAA, DyckMRA, &M);
+
+    if (!ExportVFG.empty()) {
+        RecursiveTimer SaveTimer("Saving DyckVFG");
+        if (!VFG->save(ExportVFG, DyckAA->getModuleNumbering()))
+            errs() << "Warning: cannot save the value flow graph into " << ExportVFG << "\n";
+    }
     return false;
 }
@@ -16,11 +16,13 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <llvm/ADT/SCCIterator.h>
 #include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
 #include "MRAnalyzer.h"
 #include "DyckAA/DyckGraphEdgeLabel.h"
+#include "Support/ThreadPool.h"
 #include "llvm/Support/Casting.h"
 
 MRAnalyzer::MRAnalyzer(Module *M, DyckGraph *DG, DyckCallGraph *DCG) : M(M), DG(DG), DCG(DCG) {
@@ -29,30 +31,121 @@ MRAnalyzer::MRAnalyzer(Module *M, DyckGraph *DG, DyckCallGraph *DCG) : M(M), DG(
 MRAnalyzer::~MRAnalyzer() = default;
 
 void MRAnalyzer::intraProcedureAnalysis() {
+    // the workers look up the vertices of values concurrently
+    assert(DG->hasReadOnlyLookups() && "qirunAlgorithm() has not flattened the union-find");
+    // allocate space for each function for thread safety
+    std::vector<DyckCallGraphNode *> CGNodes;
+    for (auto It = DCG->nodes_begin(), E = DCG->nodes_end(); It != E; ++It) {
+        auto *F = (*It)->getLLVMFunction();
+        if (!F) continue; // there is one and only one fake node that does not include a function
+        CGNodes.push_back(*It);
+        Func2MR[F];
+        ParReachable[F];
+    }
 
+    ThreadPool::TaskGroup Group;
+    for (auto *CGNode: CGNodes) {
+        ThreadPool::get()->enqueue(Group, [this, CGNode]() { runOnFunction(CGNode); });
+    }
+    ThreadPool::get()->wait(Group);
+    DG->clearReachableClosures();
 }
 
 void MRAnalyzer::interProcedureAnalysis() {
-    // fixme let's impl a simple version where we do not use scc and bottom-up inter-proc analysis
-    for (auto It = DCG->nodes_begin(), E = DCG->nodes_end(); It != E; ++It)
-        runOnFunction(*It);
+    assert(DG->hasReadOnlyLookups() && "qirunAlgorithm() has not flattened the union-find");
+    // sccs in a bottom-up order, i.e., an scc comes after the sccs it calls,
+    // starting from the external calling node and then from the functions it cannot reach
+    std::vector<std::vector<DyckCallGraphNode *>> SCCs;
+    DenseMap<DyckCallGraphNode *, unsigned> SCCIndices;
+    auto CollectSCCs = [&SCCs, &SCCIndices](scc_iterator<DyckCallGraphNode *> It) {
+        for (; !It.isAtEnd(); ++It) {
+            if (SCCIndices.count((*It).front())) continue;
+            for (auto *CGNode: *It) SCCIndices[CGNode] = SCCs.size();
+            SCCs.push_back(*It);
+        }
+    };
+    CollectSCCs(scc_begin(DCG->getFunction(nullptr)));
+    for (auto It = DCG->nodes_begin(), E = DCG->nodes_end(); It != E; ++It) {
+        if (!SCCIndices.count(*It)) CollectSCCs(scc_begin(*It));
+    }
+
+    // the level of an scc is one more than the highest level of the sccs it calls,
+    // so the sccs of the same level are independent of each other
+    std::vector<unsigned> SCCLevels(SCCs.size(), 0);
+    std::vector<std::vector<unsigned>> Levels;
+    for (unsigned K = 0; K < SCCs.size(); ++K) {
+        for (auto *CGNode: SCCs[K]) {
+            for (auto It = CGNode->child_begin(), E = CGNode->child_end(); It != E; ++It) {
+                unsigned CalleeSCC = SCCIndices.lookup(*It);
+                if (CalleeSCC != K) SCCLevels[K] = std::max(SCCLevels[K], SCCLevels[CalleeSCC] + 1);
+            }
+        }
+        if (Levels.size() <= SCCLevels[K]) Levels.resize(SCCLevels[K] + 1);
+        Levels[SCCLevels[K]].push_back(K);
+    }
+
+    for (auto &Level: Levels) {
+        ThreadPool::TaskGroup Group;
+        for (auto K: Level) {
+            ThreadPool::get()->enqueue(Group, [this, &SCCs, K]() { runOnSCC(SCCs[K]); });
+        }
+        ThreadPool::get()->wait(Group);
+    }
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Mod/ref SCCs: " << SCCs.size() << "\n");
+    DEBUG_WITH_TYPE("dyckaa-stats", errs() << "# Mod/ref SCC levels: " << Levels.size() << "\n");
+    ParReachable.clear();
 }
 
-void MRAnalyzer::runOnFunction(DyckCallGraphNode *CGNode) {
+void MRAnalyzer::runOnSCC(const std::vector<DyckCallGraphNode *> &SCC) {
+    // the callees out of the scc are done, so a single pass suffices unless the functions call each other
+    bool Changed;
+    do {
+        Changed = false;
+        for (auto *CGNode: SCC) Changed |= composeCallees(CGNode);
+    } while (Changed && SCC.size() > 1);
+}
+
+bool MRAnalyzer::composeCallees(DyckCallGraphNode *CGNode) {
     auto *F = CGNode->getLLVMFunction();
-    if (!F) return; // there is one and only one fake node that does not include a function
+    if (!F) return false;
+
+    auto &MR = Func2MR.at(F);
+    std::set<DyckGraphNode *> &Refs = MR.Mods;
+    std::set<DyckGraphNode *> &Mods = MR.Refs;
+    auto &ParReachableNodes = ParReachable.at(F);
+
+    // a callee accesses the memory of the caller's parameters only through vertices reachable from them
+    bool Changed = false;
+    for (auto It = CGNode->child_begin(), E = CGNode->child_end(); It != E; ++It) {
+        auto *Callee = (*It)->getLLVMFunction();
+        if (!Callee || Callee == F) continue;
+        auto &CalleeMR = Func2MR.at(Callee);
+        for (auto *RefNode: CalleeMR.Mods) {
+            if (ParReachableNodes.count(RefNode)) Changed |= Refs.insert(RefNode).second;
+        }
+        if (F->onlyReadsMemory()) continue; // a read only function
+        for (auto *ModNode: CalleeMR.Refs) {
+            if (ParReachableNodes.count(ModNode)) Changed |= Mods.insert(ModNode).second;
+        }
+    }
+    return Changed;
+}
 
-    auto &MR = Func2MR[F];
+void MRAnalyzer::runOnFunction(DyckCallGraphNode *CGNode) {
+    auto *F = CGNode->getLLVMFunction();
+    auto &MR = Func2MR.at(F);
     std::set<DyckGraphNode *> &Refs = MR.Mods;
     std::set<DyckGraphNode *> &Mods = MR.Refs;
 
     // compute a set of dyck nodes reachable from parameters and todo returns
-    std::set<DyckGraphNode *> ParReachableNodes;
+    // the closure of a parameter is computed once, however many functions share the parameter
+    auto &ParReachableNodes = ParReachable.at(F);
     std::set<DyckGraphNode *> RetReachableNodes;
     for (unsigned K = 0; K < F->arg_size(); ++K) {
         auto *DGNode = DG->findDyckVertex(F->getArg(K));
         if (!DGNode) continue;
-        DG->getReachableVertices(DGNode, ParReachableNodes);
+        auto &Reachable = DG->getReachableClosure(DGNode);
+        ParReachableNodes.insert(Reachable.begin(), Reachable.end());
     }
     for (unsigned K = 0; K < F->arg_size(); ++K) {
         auto *DGNode = DG->findDyckVertex(F->getArg(K));
@@ -63,7 +156,6 @@ void MRAnalyzer::runOnFunction(DyckCallGraphNode *CGNode) {
     // for each instruction,
     // if it refs a node that is reachable from parameters add it to refs
     // if it mods a node that is reachable from parameters add it to mods
-    outs() << F->getName().str() << "\n";
     for (auto &I: instructions(F)) {
         for (unsigned K = 0; K < I.getNumOperands(); ++K) {
             auto *Ref = I.getOperand(K);
@@ -81,7 +173,6 @@ void MRAnalyzer::runOnFunction(DyckCallGraphNode *CGNode) {
             auto *ModNode = PtrNode->getOutVertex(DG->getDereferenceEdgeLabel());
             // check if reachable from parameters and returns
             if (ParReachableNodes.count(ModNode) || RetReachableNodes.count(ModNode)) {
-                outs() << ModNode->getIndex() << "\n";
                 Mods.insert(ModNode);
             }
         }
@@ -19,6 +19,7 @@
 #ifndef DYCKAA_MRANALYZER_H
 #define DYCKAA_MRANALYZER_H
 
+#include <llvm/ADT/DenseSet.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/CommandLine.h>
 
@@ -35,6 +36,9 @@ private:
     DyckCallGraph *DCG;
     std::map<Function *, ModRef> Func2MR;
 
+    /// function -> the vertices reachable from its parameters, except the parameters themselves
+    std::map<Function *, DenseSet<DyckGraphNode *>> ParReachable;
+
 public:
     MRAnalyzer(Module *, DyckGraph *, DyckCallGraph *);
 
@@ -48,6 +52,12 @@ public:
 
 private:
     void runOnFunction(DyckCallGraphNode *);
+
+    /// add the mods and refs of the callees that are reachable from the parameters, return true if any is added
+    bool composeCallees(DyckCallGraphNode *);
+
+    /// compose the summaries of an scc until a fixed point, after the sccs it calls are done
+    void runOnSCC(const std::vector<DyckCallGraphNode *> &);
 };
 
 #endif //DYCKAA_MRANALYZER_H
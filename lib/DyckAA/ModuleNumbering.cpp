@@ -0,0 +1,123 @@
+/*
+ *  Canary features a fast unification-based alias analysis for C programs
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/Support/EndianStream.h>
+#include <llvm/Support/FileSystem.h>
+
+#include "ModuleNumbering.h"
+
+namespace {
+/// A stream that feeds everything written to it into a hasher, so that the bitcode is not buffered as a whole.
+class HashStream : public raw_ostream {
+private:
+    MD5 &Hasher;
+    uint64_t Pos = 0;
+
+    void write_impl(const char *Ptr, size_t Size) override {
+        Hasher.update(StringRef(Ptr, Size));
+        Pos += Size;
+    }
+
+    uint64_t current_pos() const override { return Pos; }
+
+public:
+    explicit HashStream(MD5 &H) : Hasher(H) { SetUnbuffered(); }
+};
+} // namespace
+
+ModuleNumbering::ModuleNumbering(Module *M) {
+    MD5 Hasher;
+    {
+        HashStream OS(Hasher);
+        WriteBitcodeToFile(*M, OS);
+    }
+    Hasher.final(Hash);
+
+    for (auto &G: M->globals()) numberUnit(&G);
+    for (auto &F: *M) numberUnit(&F);
+    for (auto &A: M->aliases()) numberUnit(&A);
+    for (auto &I: M->ifuncs()) numberUnit(&I);
+}
+
+void ModuleNumbering::numberUnit(GlobalValue *GV) {
+    SmallPtrSet<Value *, 32> Numbered;
+    unsigned Begin = Values.size();
+    number(GV, Numbered);
+    if (auto *G = dyn_cast<GlobalVariable>(GV)) {
+        if (G->hasInitializer()) number(G->getInitializer(), Numbered);
+    } else if (auto *F = dyn_cast<Function>(GV)) {
+        for (auto &Arg: F->args()) number(&Arg, Numbered);
+        for (auto &BB: *F) {
+            number(&BB, Numbered);
+            for (auto &I: BB) {
+                number(&I, Numbered);
+                for (auto *Op: I.operand_values()) number(Op, Numbered);
+            }
+        }
+    } else if (auto *A = dyn_cast<GlobalAlias>(GV)) {
+        number(A->getAliasee(), Numbered);
+    } else if (auto *I = dyn_cast<GlobalIFunc>(GV)) {
+        number(I->getResolver(), Numbered);
+    }
+    Units.push_back({GV, Begin, (unsigned) Values.size()});
+}
+
+void ModuleNumbering::number(Value *V, SmallPtrSetImpl<Value *> &Numbered) {
+    if (!Numbered.insert(V).second) return;
+    ValueIDs.try_emplace(V, Values.size());
+    Values.push_back(V);
+    if (isa<Constant>(V) && !isa<GlobalValue>(V)) {
+        for (auto *Op: cast<Constant>(V)->operand_values()) number(Op, Numbered);
+    }
+}
+
+void appendWords(std::vector<uint32_t> &Words, const MD5::MD5Result &Hash) {
+    for (unsigned K = 0; K < 4; ++K) Words.push_back(support::endian::read32le(Hash.Bytes.data() + 4 * K));
+}
+
+void appendWords(std::vector<uint32_t> &Words, StringRef Str) {
+    for (size_t K = 0; K < Str.size(); K += 4) {
+        char Word[4] = {0, 0, 0, 0};
+        std::copy(Str.begin() + K, Str.begin() + std::min(K + 4, Str.size()), Word);
+        Words.push_back(support::endian::read32le(Word));
+    }
+}
+
+bool writeNumberedFile(StringRef Path, ArrayRef<uint32_t> Words) {
+    int FD;
+    SmallString<128> TempPath;
+    if (sys::fs::createUniqueFile(Path + ".tmp%%%%%%", FD, TempPath)) return false;
+    {
+        raw_fd_ostream OS(FD, /* shouldClose */ true);
+        support::endian::Writer W(OS, support::little);
+        W.write(Words);
+        OS.close();
+        if (OS.has_error()) {
+            OS.clear_error();
+            sys::fs::remove(TempPath);
+            return false;
+        }
+    }
+    if (sys::fs::rename(TempPath, Path)) {
+        sys::fs::remove(TempPath);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,163 @@
+/*
+ *  Canary features a fast unification-based alias analysis for C programs
+ *  Copyright (C) 2021 Qingkai Shi <qingkaishi@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DYCKAA_MODULENUMBERING_H
+#define DYCKAA_MODULENUMBERING_H
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/SwapByteOrder.h>
+#include <vector>
+
+using namespace llvm;
+
+/// A numbering of the values in a module, together with the hash of the module's bitcode.
+/// The module is split into units, i.e., the global variables, functions, aliases and ifuncs in the module order,
+/// each of which is numbered consecutively with the values it defines and uses: a global variable with the
+/// constants in its initializer, a function with its arguments, basic blocks, instructions and their operands.
+/// A value used by more than one unit is numbered in each of them, so the numbers of a unit only depend on
+/// the unit itself, and are the same for the same unit in different versions of a module.
+class ModuleNumbering {
+public:
+    struct Unit {
+        GlobalValue *GV;
+        /// the range of the numbers of the unit
+        unsigned Begin, End;
+    };
+
+    static const unsigned InvalidID = ~0U;
+
+private:
+    MD5::MD5Result Hash;
+
+    /// number -> value, and the first number of each value
+    /// @{
+    std::vector<Value *> Values;
+    DenseMap<Value *, unsigned> ValueIDs;
+    /// @}
+
+    std::vector<Unit> Units;
+
+public:
+    explicit ModuleNumbering(Module *M);
+
+    /// the hash of the module's bitcode
+    const MD5::MD5Result &getModuleHash() const { return Hash; }
+
+    unsigned size() const { return Values.size(); }
+
+    ArrayRef<Value *> values() const { return Values; }
+
+    ArrayRef<Unit> units() const { return Units; }
+
+    /// return InvalidID if the value is not in the module
+    unsigned getID(Value *V) const {
+        auto It = ValueIDs.find(V);
+        return It == ValueIDs.end() ? InvalidID : It->second;
+    }
+
+private:
+    void number(Value *V, SmallPtrSetImpl<Value *> &Numbered);
+
+    void numberUnit(GlobalValue *GV);
+};
+
+/// Append the hash, or a string padded with zeros to words, to the words of a file.
+/// @{
+void appendWords(std::vector<uint32_t> &Words, const MD5::MD5Result &Hash);
+
+void appendWords(std::vector<uint32_t> &Words, StringRef Str);
+/// @}
+
+/// Write the words into the file in little endian, through a temporary file that is renamed into place,
+/// so that a concurrent reader never sees a partial file. Return false if the file cannot be written.
+bool writeNumberedFile(StringRef Path, ArrayRef<uint32_t> Words);
+
+/// Read the little-endian 32-bit words of a file that refers to values by their numbers, with bound checks.
+/// The numbers are resolved by a map, which is the ModuleNumbering of the module the file was written for.
+class NumberingReader {
+private:
+    const char *Ptr;
+    const char *End;
+    ArrayRef<Value *> Values;
+
+public:
+    NumberingReader(StringRef Buffer, ArrayRef<Value *> Values)
+            : Ptr(Buffer.begin()), End(Buffer.end()), Values(Values) {}
+
+    void setValues(ArrayRef<Value *> NewValues) { Values = NewValues; }
+
+    bool atEnd() const { return Ptr == End; }
+
+    bool read(uint32_t &Word) {
+        if (End - Ptr < 4) return false;
+        Word = support::endian::read32le(Ptr);
+        Ptr += 4;
+        return true;
+    }
+
+    /// read a value of the type \p T, which may be null only if \p AllowNull is true
+    template<typename T>
+    bool read(T *&V, bool AllowNull = false) {
+        uint32_t ID;
+        if (!read(ID)) return false;
+        if (ID == ModuleNumbering::InvalidID) {
+            V = nullptr;
+            return AllowNull;
+        }
+        V = ID < Values.size() ? dyn_cast_or_null<T>(Values[ID]) : nullptr;
+        return V != nullptr;
+    }
+
+    /// Refer to the next \p Size words in place if the host is little endian and the buffer is word-aligned,
+    /// which are copied into \p Storage otherwise.
+    bool read(ArrayRef<uint32_t> &Words, size_t Size, std::vector<uint32_t> &Storage) {
+        if ((uint64_t) (End - Ptr) / 4 < Size) return false;
+        if (sys::IsLittleEndianHost && reinterpret_cast<uintptr_t>(Ptr) % alignof(uint32_t) == 0) {
+            Words = makeArrayRef(reinterpret_cast<const uint32_t *>(Ptr), Size);
+            Ptr += Size * 4;
+            return true;
+        }
+        Storage.resize(Size);
+        for (auto &Word: Storage) read(Word);
+        Words = Storage;
+        return true;
+    }
+
+    /// read the 16 bytes of a hash
+    bool read(MD5::MD5Result &Hash) {
+        if (End - Ptr < 16) return false;
+        std::copy(Ptr, Ptr + 16, Hash.Bytes.begin());
+        Ptr += 16;
+        return true;
+    }
+
+    /// read a string of \p Size bytes, which is padded to words
+    bool read(std::string &Str, uint32_t Size) {
+        uint32_t Padded = (Size + 3) & ~3U;
+        if ((uint64_t) (End - Ptr) < Padded) return false;
+        Str.assign(Ptr, Size);
+        Ptr += Padded;
+        return true;
+    }
+};
+
+#endif // DYCKAA_MODULENUMBERING_H
@@ -108,7 +108,7 @@ bool MLDAllocationAnalysis::dfsearchAllocationSiteReached(DyckGraphNode *Start,
         ret = true;
         AllocationIndexes.insert(Start->getIndex());
     }
-    std::map<DyckGraphEdgeLabel *, std::set<DyckGraphNode *>> &outNodes = Start->getOutVertices();
+    DyckGraphEdgeMap &outNodes = Start->getOutVertices();
     for (auto edgeNodeSetPairIt = outNodes.begin(); edgeNodeSetPairIt != outNodes.end(); edgeNodeSetPairIt++) {
         for (auto outNodeIt = edgeNodeSetPairIt->second.begin(); outNodeIt != edgeNodeSetPairIt->second.end(); outNodeIt++) {
             if (dfsearchAllocationSiteReached(*outNodeIt, DyckGraph, DepthLimit - 1, Visited, EdgeSet, AllocationIndexes)) {
@@ -158,7 +158,7 @@ NaiveAliasGraph::NaiveAliasGraph(const DeclareFunctionDesc &FuncDesc)
         this->retNode = nullptr;
     }
     if (returnIsAliasWithAllocation) {
-        API::HeapAllocFunctions.insert(FuncDesc.FunctionName);
+        API::addHeapAllocFunction(FuncDesc.FunctionName);
     }
     // if access to any return node, then inserOrGetNode function would return the one created previously, and the second
     // argument would not be used.
@@ -4,10 +4,15 @@
 #include "DyckAA/DyckCallGraph.h"
 #include "DyckAA/DyckVFG.h"
 #include "Support/API.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/IR/Argument.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <iostream>
 #include <queue>
 #include <set>
@@ -15,32 +20,42 @@
 #include <system_error>
 #include <utility>
 
+static cl::opt<unsigned> ContextLimit("mld-context-limit",
+                                      cl::desc("Use call strings of at most this length for the forward slices "
+                                               "instead of function summaries. Default is 0, i.e., use summaries."),
+                                      cl::init(0), cl::Hidden);
+
+static cl::opt<unsigned> BatchSize("mld-batch-size",
+                                   cl::desc("The number of sources whose slices are computed together. "
+                                            "0 computes the slices one by one."),
+                                   cl::init(256), cl::Hidden);
 
 // This function is used to construct MLD VFG
 MLDVFG::MLDVFG(DyckVFG *VFG, DyckCallGraph *DyckCG)
     : VFG(VFG),
       DyckCG(DyckCG),
       DyckAA(nullptr) {
+    std::vector<DyckVFGNode *> Sources;
     for (auto VFGNodeIt = VFG->node_begin(); VFGNodeIt != VFG->node_end(); VFGNodeIt++) {
         if (isa<Instruction>((*VFGNodeIt)->getValue()) && API::isHeapAllocate((Instruction *)(*VFGNodeIt)->getValue())) {
             SourcesSet.insert(*VFGNodeIt);
-            ForwardReachable(*VFGNodeIt);
-            BackwardReachable(*VFGNodeIt);
-            // printSlice(LeakMap[*VFGNodeIt]);
+            Sources.push_back(*VFGNodeIt);
         }
     }
+    computeSlices(Sources, true);
 }
 
 // This function is used to construct allocation notation VFG.
 MLDVFG::MLDVFG(DyckVFG *VFG, DyckCallGraph *DyckCG, DyckAliasAnalysis *DyckAA)
     :VFG(VFG), DyckCG(DyckCG), DyckAA(DyckAA){
+    std::vector<DyckVFGNode *> Sources;
     for (auto VFGNodeIt = VFG->node_begin(); VFGNodeIt != VFG->node_end(); VFGNodeIt++) {
         if (isa<Instruction>((*VFGNodeIt)->getValue()) && API::isHeapAllocate((Instruction *)(*VFGNodeIt)->getValue())) {
             SourcesSet.insert(*VFGNodeIt);
-            ForwardReachable(*VFGNodeIt);
-            
+            Sources.push_back(*VFGNodeIt);
         }
     }
+    computeSlices(Sources, false);
     for (auto &sourceSlicePair:LeakMap){
         Slice & sourceSlice = sourceSlicePair.second;
         for (auto sourceNodeIt = sourceSlice.reach_begin();sourceNodeIt != sourceSlice.reach_end(); sourceNodeIt++){
@@ -58,7 +73,292 @@ MLDVFG::~MLDVFG() {
     delete this;
 }
 
+void MLDVFG::computeSlices(const std::vector<DyckVFGNode *> &Sources, bool Backward) {
+    // call strings cannot be shared by sources, so they are only supported one by one
+    if (ContextLimit.getValue() || !BatchSize.getValue()) {
+        for (auto *Source : Sources) {
+            ForwardReachable(Source);
+            if (Backward)
+                BackwardReachable(Source);
+        }
+        return;
+    }
+
+    if (!SummariesComputed)
+        computeSummaries();
+    IndexedNodes.resize(VFG->numNodes());
+    for (auto VFGNodeIt = VFG->node_begin(); VFGNodeIt != VFG->node_end(); VFGNodeIt++)
+        IndexedNodes[(*VFGNodeIt)->getIndex()] = *VFGNodeIt;
+    for (unsigned K = 0; K < Sources.size(); K += BatchSize.getValue()) {
+        auto End = Sources.begin() + std::min<size_t>(K + BatchSize.getValue(), Sources.size());
+        computeSliceBatch(std::vector<DyckVFGNode *>(Sources.begin() + K, End), Backward);
+    }
+}
+
+void MLDVFG::computeSliceBatch(const std::vector<DyckVFGNode *> &Sources, bool Backward) {
+    const unsigned NumNodes = IndexedNodes.size();
+    const unsigned Width = Sources.size();
+    std::vector<Slice> Slices;
+    for (auto *Source : Sources)
+        Slices.emplace_back(Source);
+
+    // node index -> the sources reaching it before/after an unmatched call, as in ForwardReachableWithSummaries,
+    // which are allocated when the node is first reached
+    std::vector<BitVector> Reach[2] = {std::vector<BitVector>(NumNodes), std::vector<BitVector>(NumNodes)};
+    BitVector InList[2] = {BitVector(NumNodes), BitVector(NumNodes)};
+    std::queue<std::pair<unsigned, bool>> Worklist;
+    auto Join = [&](const BitVector &Bits, DyckVFGNode *N, bool InCallee) {
+        unsigned Idx = N->getIndex();
+        auto &Dst = Reach[InCallee][Idx];
+        if (Dst.empty())
+            Dst.resize(Width);
+        if (!Bits.test(Dst))
+            return;
+        Dst |= Bits;
+        if (!InList[InCallee][Idx]) {
+            InList[InCallee].set(Idx);
+            Worklist.push({Idx, InCallee});
+        }
+    };
+    for (unsigned K = 0; K < Width; ++K) {
+        BitVector Bits(Width);
+        Bits.set(K);
+        Join(Bits, Sources[K], false);
+    }
+    while (!Worklist.empty()) {
+        auto Curr = Worklist.front();
+        Worklist.pop();
+        InList[Curr.second].reset(Curr.first);
+        // the bits of a node are only changed by joining different bits, so the reference is safe on self loops
+        const BitVector &Bits = Reach[Curr.second][Curr.first];
+        for (auto Edge : *IndexedNodes[Curr.first]) {
+            if (Edge.second == 0) {
+                Join(Bits, Edge.first, Curr.second);
+            }
+            else if (Edge.second > 0) {
+                Join(Bits, Edge.first, true);
+                auto It = Summaries.find({Edge.first, Edge.second});
+                if (It != Summaries.end())
+                    for (auto *Returned : It->second)
+                        Join(Bits, Returned, Curr.second);
+            }
+            else if (!Curr.second) {
+                Join(Bits, Edge.first, false);
+            }
+        }
+    }
+
+    // materialize the forward slices, and keep the union of both states for the backward pass
+    std::vector<BitVector> &Forward = Reach[0];
+    for (unsigned Idx = 0; Idx < NumNodes; ++Idx) {
+        if (Reach[1][Idx].empty())
+            continue;
+        if (Forward[Idx].empty())
+            Forward[Idx].resize(Width);
+        Forward[Idx] |= Reach[1][Idx];
+    }
+    std::vector<BitVector>().swap(Reach[1]);
+    for (unsigned Idx = 0; Idx < NumNodes; ++Idx) {
+        if (Forward[Idx].none())
+            continue;
+        auto *N = IndexedNodes[Idx];
+        bool IsSink = isa<Argument>(N->getValue()) && API::isRustSinkForC(dyn_cast<Argument>(N->getValue()));
+        for (unsigned K : Forward[Idx].set_bits()) {
+            Slices[K].addReachable(N);
+            if (IsSink)
+                Slices[K].addSink(N);
+        }
+    }
+
+    if (Backward) {
+        // propagate the sources from their sinks backward, within their forward slices
+        std::vector<BitVector> BackReach(NumNodes);
+        BitVector SlicesToPrune(Width);
+        for (unsigned K = 0; K < Width; ++K) {
+            if (Slices[K].sinkSetEmpty())
+                continue;
+            SlicesToPrune.set(K);
+            for (auto Sink = Slices[K].sinks_begin(); Sink != Slices[K].sinks_end(); Sink++) {
+                auto &Bits = BackReach[(*Sink)->getIndex()];
+                if (Bits.empty())
+                    Bits.resize(Width);
+                Bits.set(K);
+                if (!InList[0][(*Sink)->getIndex()]) {
+                    InList[0].set((*Sink)->getIndex());
+                    Worklist.push({(*Sink)->getIndex(), false});
+                }
+            }
+        }
+        while (!Worklist.empty()) {
+            unsigned Idx = Worklist.front().first;
+            Worklist.pop();
+            InList[0].reset(Idx);
+            for (auto Edge = IndexedNodes[Idx]->in_begin(); Edge != IndexedNodes[Idx]->in_end(); Edge++) {
+                unsigned PredIdx = Edge->first->getIndex();
+                if (Forward[PredIdx].empty())
+                    continue;
+                BitVector Bits(BackReach[Idx]);
+                Bits &= Forward[PredIdx];
+                auto &Dst = BackReach[PredIdx];
+                if (Dst.empty())
+                    Dst.resize(Width);
+                if (!Bits.test(Dst))
+                    continue;
+                Dst |= Bits;
+                if (!InList[0][PredIdx]) {
+                    InList[0].set(PredIdx);
+                    Worklist.push({PredIdx, false});
+                }
+            }
+        }
+
+        // the slices with sinks only keep the nodes reaching the sinks
+        for (unsigned K : SlicesToPrune.set_bits()) {
+            Slice Pruned(Sources[K]);
+            for (auto Sink = Slices[K].sinks_begin(); Sink != Slices[K].sinks_end(); Sink++)
+                Pruned.addSink(*Sink);
+            Slices[K] = std::move(Pruned);
+        }
+        for (unsigned Idx = 0; Idx < NumNodes; ++Idx) {
+            if (BackReach[Idx].empty())
+                continue;
+            for (unsigned K : BackReach[Idx].set_bits())
+                Slices[K].addReachable(IndexedNodes[Idx]);
+        }
+    }
+
+    for (unsigned K = 0; K < Width; ++K)
+        LeakMap[Sources[K]] = std::move(Slices[K]);
+}
+
 void MLDVFG::ForwardReachable(DyckVFGNode *VFGNode) {
+    if (ContextLimit.getValue())
+        ForwardReachableWithContexts(VFGNode, ContextLimit.getValue());
+    else
+        ForwardReachableWithSummaries(VFGNode);
+}
+
+void MLDVFG::computeSummaries() {
+    // tabulate the nodes reachable from each entry, i.e., the target of a call edge, through matched calls and returns.
+    // a caller (entry, call id) of an entry is notified of each node reached from the entry, whose return edges with
+    // the call id extend what the caller reaches.
+    DenseMap<DyckVFGNode *, unsigned> EntryID;
+    std::vector<DyckVFGNode *> Entries;
+    std::vector<DenseSet<DyckVFGNode *>> Reach;
+    std::vector<std::vector<DyckVFGNode *>> ReachList;
+    std::vector<std::set<std::pair<unsigned, int>>> Callers;
+    std::vector<std::pair<unsigned, DyckVFGNode *>> Worklist;
+
+    auto Add = [&](unsigned E, DyckVFGNode *N) {
+        if (Reach[E].insert(N).second) {
+            ReachList[E].push_back(N);
+            Worklist.emplace_back(E, N);
+        }
+    };
+    auto GetEntry = [&](DyckVFGNode *N) {
+        auto It = EntryID.find(N);
+        if (It != EntryID.end())
+            return It->second;
+        unsigned E = Entries.size();
+        EntryID[N] = E;
+        Entries.push_back(N);
+        Reach.emplace_back();
+        ReachList.emplace_back();
+        Callers.emplace_back();
+        Add(E, N);
+        return E;
+    };
+    auto AddReturns = [&](DyckVFGNode *N, unsigned CallerE, int CallId) {
+        for (auto Edge : *N)
+            if (Edge.second == -CallId)
+                Add(CallerE, Edge.first);
+    };
+
+    for (auto VFGNodeIt = VFG->node_begin(); VFGNodeIt != VFG->node_end(); VFGNodeIt++)
+        for (auto Edge : **VFGNodeIt)
+            if (Edge.second > 0)
+                GetEntry(Edge.first);
+
+    while (!Worklist.empty()) {
+        auto Curr = Worklist.back();
+        Worklist.pop_back();
+        unsigned E = Curr.first;
+        for (auto &Caller : Callers[E])
+            AddReturns(Curr.second, Caller.first, Caller.second);
+        for (auto Edge : *Curr.second) {
+            if (Edge.second == 0) {
+                Add(E, Edge.first);
+            }
+            else if (Edge.second > 0) {
+                unsigned Callee = GetEntry(Edge.first);
+                if (!Callers[Callee].emplace(E, Edge.second).second)
+                    continue;
+                // the list may grow when the callee is the entry itself
+                for (unsigned K = 0; K < ReachList[Callee].size(); ++K)
+                    AddReturns(ReachList[Callee][K], E, Edge.second);
+            }
+        }
+    }
+
+    for (unsigned E = 0; E < Entries.size(); ++E) {
+        for (auto &Caller : Callers[E]) {
+            auto Inserted = Summaries.emplace(std::make_pair(Entries[E], Caller.second), std::vector<DyckVFGNode *>());
+            if (!Inserted.second)
+                continue;
+            auto &Targets = Inserted.first->second;
+            std::set<DyckVFGNode *> Returned;
+            for (auto *N : ReachList[E])
+                for (auto Edge : *N)
+                    if (Edge.second == -Caller.second)
+                        Returned.insert(Edge.first);
+            Targets.assign(Returned.begin(), Returned.end());
+        }
+    }
+    SummariesComputed = true;
+}
+
+void MLDVFG::ForwardReachableWithSummaries(DyckVFGNode *VFGNode) {
+    if (!SummariesComputed)
+        computeSummaries();
+
+    // a node is visited either before any unmatched call, where unmatched returns are allowed,
+    // or after an unmatched call, where only returns matched by the summaries are allowed
+    Slice ForwardSlice(VFGNode);
+    DenseSet<DyckVFGNode *> Visited[2];
+    std::queue<std::pair<DyckVFGNode *, bool>> Worklist;
+    auto Visit = [&](DyckVFGNode *N, bool InCallee) {
+        if (Visited[InCallee].insert(N).second)
+            Worklist.push({N, InCallee});
+    };
+    Visit(VFGNode, false);
+    while (!Worklist.empty()) {
+        auto CurrPair = Worklist.front();
+        Worklist.pop();
+        /// add into reachable set
+        if (isa<Argument>(CurrPair.first->getValue()) && API::isRustSinkForC(dyn_cast<Argument>(CurrPair.first->getValue()))) {
+            ForwardSlice.addSink(CurrPair.first);
+        }
+        ForwardSlice.addReachable(CurrPair.first);
+        for (auto Edge : *CurrPair.first) {
+            if (Edge.second == 0) {
+                Visit(Edge.first, CurrPair.second);
+            }
+            else if (Edge.second > 0) {
+                Visit(Edge.first, true);
+                auto It = Summaries.find({Edge.first, Edge.second});
+                if (It != Summaries.end())
+                    for (auto *Returned : It->second)
+                        Visit(Returned, CurrPair.second);
+            }
+            else if (!CurrPair.second) {
+                Visit(Edge.first, false);
+            }
+        }
+    }
+    LeakMap[VFGNode] = std::move(ForwardSlice);
+}
+
+void MLDVFG::ForwardReachableWithContexts(DyckVFGNode *VFGNode, unsigned K) {
     Slice ForwardSlice(VFGNode);
     std::map<DyckVFGNode *, std::set<Context>> ForwardCFLReach;
     std::queue<NodeContextTy> Worklist;
@@ -79,6 +379,9 @@ void MLDVFG::ForwardReachable(DyckVFGNode *VFGNode) {
             if (Edge->second > 0) {
                 if (!NewCxt.count(Edge->second))
                     NewCxt.push(Edge->second);
+                // forget the oldest call, after which its return is treated as unmatched
+                if (NewCxt.instance.size() > K)
+                    NewCxt.instance.erase(NewCxt.instance.begin());
             }
             /// if label <0 , then it'a a ret edge, pop call info from stack
             else if (Edge->second < 0) {
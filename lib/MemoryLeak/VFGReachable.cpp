@@ -5,6 +5,10 @@
 #include "DyckAA/DyckVFG.h"
 #include "MemoryLeak/MLDReport.h"
 #include "MemoryLeak/MLDVFG.h"
+#include "Support/ThreadPool.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/iterator_range.h"
 #include "llvm/Analysis/PostDominators.h"
 #include "llvm/IR/BasicBlock.h"
@@ -16,6 +20,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Value.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cassert>
 #include <cstddef>
@@ -30,72 +35,121 @@
 
 static int BranchCounter = 1;
 
-static int BBIDCounter = 0;
-static std::map<BasicBlock *, int> BBID;
+/// conjunction and disjunction that fold boolean literals, so that more queries can be decided syntactically
+/// @{
+static expr conj(const expr &A, const expr &B) {
+    if (A.is_true() || B.is_false())
+        return B;
+    if (B.is_true() || A.is_false())
+        return A;
+    return A && B;
+}
 
-void VFGReachable::addBBID(BasicBlock *bb) {
-    if (!BBID.count(bb)) {
-        BBID[bb] = BBIDCounter++;
-    }
+static expr disj(const expr &A, const expr &B) {
+    if (A.is_false() || B.is_true())
+        return B;
+    if (B.is_false() || A.is_true())
+        return A;
+    return A || B;
 }
+/// @}
+
 
 VFGReachable::VFGReachable(llvm::Module &M, MLDVFG *MVFG, DyckAliasAnalysis *DAA)
     : MVFG(MVFG),
-      DAA(DAA),
-      GlobalSolver(GlobalContext) {
-    // init branch condition for each terminator instruction of basic blocks respectively.
+      DAA(DAA) {
+    // number the branch variable for each terminator instruction of basic blocks respectively,
+    // whose conditions are built lazily in the context of each thread.
     for (auto &F : M) {
         auto CtrlFlowGraph = std::make_shared<CFG>(&F);
         CFGMap.insert({&F, CtrlFlowGraph});
         for (auto &BB : make_range(F.begin(), F.end())) {
-            // BBID[&BB] = BBIDCounter++;
-            addBBID(&BB);
-            Instruction *TerminatorInst = BB.getTerminator();
-            if (TerminatorInst->getNumSuccessors() == 1) {
-                BranchBBCond[&BB].push_back(GlobalContext.bool_val(true));
-                continue;
-            }
-            if (auto BrInst = dyn_cast<BranchInst>(TerminatorInst)) {
-                expr BrVar = GlobalContext.bool_const(("B" + std::to_string(BranchCounter++)).c_str());
-                //std::string inst;
-                //raw_string_ostream s(inst);
-                //s << *BrInst;
-                //std::cout << BranchCounter - 1 << "   " << inst << std::endl;
-                BranchBBCond[&BB].push_back(BrVar);
-                BranchBBCond[&BB].push_back(!BrVar);
-            }
-            else if (auto SwInst = dyn_cast<SwitchInst>(TerminatorInst)) {
-                expr SwVar = GlobalContext.int_const(("I" + std::to_string(BranchCounter++)).c_str());
-                expr Default = GlobalContext.bool_val(true);
-                std::vector<expr> ev;
-                for (int i = 1; i < SwInst->getNumSuccessors(); i++) {
-                    auto CmpValue = SwInst->getOperand(2 * i);
-                    auto IntValue = (int)*(dyn_cast<ConstantInt>(CmpValue)->getValue().getRawData());
-                    expr IntConstExpr = GlobalContext.int_val(IntValue);
-                    ev.push_back(SwVar == IntConstExpr);
-                    Default = Default && SwVar != IntConstExpr;
-                }
-                ev.insert(ev.begin(), Default);
-                BranchBBCond[&BB].insert(BranchBBCond[&BB].end(), ev.begin(), ev.end());
-            }
-            else {
-                expr BrVar = GlobalContext.int_const(("I" + std::to_string(BranchCounter++)).c_str());
-                for (int i = 0; i < TerminatorInst->getNumSuccessors(); i++) {
-                    expr IntVal = GlobalContext.int_val(i);
-                    BranchBBCond[&BB].push_back(BrVar == i);
-                }
-            }
+            if (BB.getTerminator()->getNumSuccessors() != 1)
+                BranchID[&BB] = BranchCounter++;
         }
         FuncDomTree[&F] = PostDominatorTree(F);
+        // the dfs numbers make dominance queries read-only, which are then safe to run in parallel,
+        // while the tree of a declaration is empty and never queried
+        if (!F.isDeclaration())
+            FuncDomTree[&F].updateDFSNumbers();
+    }
+}
+
+const std::vector<expr> &VFGReachable::getBranchConds(BasicBlock *BB) {
+    auto &L = local();
+    auto It = L.BranchBBCond.find(BB);
+    if (It != L.BranchBBCond.end())
+        return It->second;
+
+    auto &Conds = L.BranchBBCond[BB];
+    Instruction *TerminatorInst = BB->getTerminator();
+    if (TerminatorInst->getNumSuccessors() == 1) {
+        Conds.push_back(L.Ctx.bool_val(true));
+        return Conds;
+    }
+    int ID = BranchID.at(BB);
+    if (isa<BranchInst>(TerminatorInst)) {
+        expr BrVar = L.Ctx.bool_const(("B" + std::to_string(ID)).c_str());
+        Conds.push_back(BrVar);
+        Conds.push_back(!BrVar);
+    }
+    else if (auto SwInst = dyn_cast<SwitchInst>(TerminatorInst)) {
+        expr SwVar = L.Ctx.int_const(("I" + std::to_string(ID)).c_str());
+        expr Default = L.Ctx.bool_val(true);
+        std::vector<expr> ev;
+        for (int i = 1; i < SwInst->getNumSuccessors(); i++) {
+            auto CmpValue = SwInst->getOperand(2 * i);
+            auto IntValue = (int)*(dyn_cast<ConstantInt>(CmpValue)->getValue().getRawData());
+            expr IntConstExpr = L.Ctx.int_val(IntValue);
+            ev.push_back(SwVar == IntConstExpr);
+            Default = Default && SwVar != IntConstExpr;
+        }
+        ev.insert(ev.begin(), Default);
+        Conds.insert(Conds.end(), ev.begin(), ev.end());
     }
+    else {
+        expr BrVar = L.Ctx.int_const(("I" + std::to_string(ID)).c_str());
+        for (int i = 0; i < TerminatorInst->getNumSuccessors(); i++) {
+            Conds.push_back(BrVar == i);
+        }
+    }
+    return Conds;
 }
 
 void VFGReachable::solveAllSlices() {
-    for (auto SliceIt = MVFG->begin(); SliceIt != MVFG->end(); SliceIt++) {
-        CurrSlice = &SliceIt->second;
-        MLDReport report = solveReachable();
-        std::cout << report.toString() << "\n";
+    // slices are independent, so they are solved in parallel, and the reports are printed in the order of slices
+    std::vector<Slice *> Slices;
+    for (auto SliceIt = MVFG->begin(); SliceIt != MVFG->end(); SliceIt++)
+        Slices.push_back(&SliceIt->second);
+    std::vector<MLDReport> Reports(Slices.size(), MLDReport(nullptr, MLDReport::NeverFree));
+
+    ThreadPool::get()->initThreadLocal<SolverLocal>();
+    ThreadPool::TaskGroup Group;
+    for (unsigned K = 0; K < Slices.size(); ++K) {
+        ThreadPool::get()->enqueue(Group, [this, &Slices, &Reports, K]() {
+            local().CurrSlice = Slices[K];
+            Reports[K] = solveReachable();
+        });
     }
+    ThreadPool::get()->wait(Group);
+    ThreadPool::get()->deinitThreadLocal<SolverLocal>();
+
+    for (auto &Report : Reports)
+        std::cout << Report.toString() << "\n";
+    DEBUG_WITH_TYPE("mld-stats", errs() << "# Solver calls: " << NumSolverCalls << "\n");
+    DEBUG_WITH_TYPE("mld-stats", errs() << "# Solver calls avoided: " << NumSolverCallsAvoided << "\n");
+    DEBUG_WITH_TYPE("mld-stats", errs() << "# Intra-procedural condition queries: " << NumIntraCondQueries << "\n");
+    DEBUG_WITH_TYPE("mld-stats", errs() << "# Intra-procedural conditions computed: " << NumIntraCondComputed << "\n");
+}
+
+z3::check_result VFGReachable::check(const expr &Formula) {
+    auto &Solver = local().IncSolver;
+    ++NumSolverCalls;
+    Solver.push();
+    Solver.add(Formula);
+    z3::check_result Result = Solver.check();
+    Solver.pop();
+    return Result;
 }
 
 const Call *VFGReachable::getCallSite(int id) {
@@ -103,6 +157,8 @@ const Call *VFGReachable::getCallSite(int id) {
 }
 
 MLDReport VFGReachable::solveReachable() {
+    auto &L = local();
+    Slice *CurrSlice = L.CurrSlice;
     if (CurrSlice->sinks_begin() == CurrSlice->sinks_end()) {
         return MLDReport(CurrSlice->getSource()->getValue(), MLDReport::NeverFree);
     }
@@ -121,9 +177,12 @@ MLDReport VFGReachable::solveReachable() {
         }
         expr ParentCond = VFGNodeCond.at(Curr);
         for (auto Edge = Curr->begin(); Edge != Curr->end(); Edge++) {
-            BBCond.clear();
             if (!CurrSlice->contains(Edge->first))
                 continue;
+            // a node keeps the condition of its first visit, since a later visit would only replace it if
+            // (OldCond || Cond) == Cond were unsat, i.e., if OldCond were valid, which the disjunction is as well
+            if (VFGNodeCond.count(Edge->first))
+                continue;
             expr Cond = getTrueCond();
             // outs() << *Curr->getValue() << "    " << *Edge->first->getValue() << "\n";
             if (Edge->second == 0) {
@@ -145,35 +204,26 @@ MLDReport VFGReachable::solveReachable() {
             //raw_string_ostream s(v);
             //s << *Edge->first->getValue();
             //std::cout << "\033[34m Cond :" << Cond << "  " << v << "\033[0m" << std::endl;
-            Cond = Cond && ParentCond;
-            if (VFGNodeCond.count(Edge->first)) {
-                expr UpdateCond = VFGNodeCond.at(Edge->first) || Cond;
-
-                z3::solver Solver(GlobalContext);
-                Solver.add(UpdateCond == Cond);
-                if (Solver.check() == z3::unsat) {
-                    VFGNodeCond.erase(Edge->first);
-                    VFGNodeCond.insert({Edge->first, UpdateCond});
-                    // std::cout << "update" << v;
-                    WorkList.push(Edge->first);
-                }
-            }
-            else {
-                VFGNodeCond.insert({Edge->first, Cond});
-                WorkList.push(Edge->first);
-            }
+            Cond = conj(Cond, ParentCond);
+            VFGNodeCond.insert({Edge->first, Cond});
+            WorkList.push(Edge->first);
         }
     }
 
     expr FinalGoal = getFalseCond();
     for (auto Sink = CurrSlice->sinks_begin(); Sink != CurrSlice->sinks_end(); Sink++) {
-        FinalGoal = FinalGoal || VFGNodeCond.at(*Sink);
+        FinalGoal = disj(FinalGoal, VFGNodeCond.at(*Sink));
     }
 
-    z3::solver FinalSolver(GlobalContext);
     // std::cout << "\033[35mFinalGoal" << FinalGoal << "\033[0m" << std::endl;
-    FinalSolver.add(FinalGoal == getFalseCond());
-    z3::check_result Result = FinalSolver.check();
+    z3::check_result Result;
+    if (FinalGoal.is_true() || FinalGoal.is_false()) {
+        Result = FinalGoal.is_true() ? z3::unsat : z3::sat;
+        ++NumSolverCallsAvoided;
+    }
+    else {
+        Result = check(FinalGoal == getFalseCond());
+    }
     MLDReport::ReportType Report = MLDReport::NeverFree;
     if (Result == z3::sat) {
         Report = MLDReport::PartialFree;
@@ -184,70 +234,149 @@ MLDReport VFGReachable::solveReachable() {
     return MLDReport(CurrSlice->getSource()->getValue(), Report);
 }
 
-void VFGReachable::computerIntraCond(BasicBlock *src, BasicBlock *dst, std::vector<int> visited,
-                                     std::vector<std::pair<BasicBlock *, int>> pathCondition) {
-    int srcID = BBID[src];
-    int dstID = BBID[dst];
-    // outs() << src->getName() << "\n";
-    // std::cout << "caonima" << std::endl;
-    visited[srcID] += 1;
-    if (src == dst) {
-        expr FinalCond = getTrueCond();
-        for (auto BBIdx : pathCondition) {
-            FinalCond = FinalCond && BranchBBCond[BBIdx.first][BBIdx.second];
-        }
-        if (BBCond.find(dst) != BBCond.end()) {
-            // std::cout << "\033[35mFinalCond: " << (FinalCond || BBCond.at(dst)) << "\033[0m" << std::endl;
-            FinalCond = FinalCond || BBCond.at(dst );
-            BBCond.erase(dst);
-            BBCond.insert(std::make_pair(dst, FinalCond));
-        }
-        else
-            BBCond.insert({dst, FinalCond});
-        // std::cout << "\033[36mdst: " << BBCond.at(dst) << "\033[0m" << std::endl;
-    }
-    else if (visited[srcID] == 1) {
-        int idx = 0;
-        for (auto Succ : successors(src)) {
-            int SuccID = BBID[Succ];
-            if (visited[SuccID] <= 1 && reachable(Succ, dst)) {
-                pathCondition.push_back({src, idx});
-                // std::cout << BranchBBCond[src][idx] << std::endl;
-                computerIntraCond(Succ, dst, visited, pathCondition);
-                pathCondition.pop_back();
-            }
-            idx++;
-        }
-    }
-    else if (visited[srcID] == 2) {
-        if (succ_size(src) == 2) {
-            for (auto Succ : successors(src)) {
-                int SuccID = BBID[Succ];
-                if (visited[SuccID] == 0 && reachable(Succ, dst)) {
-                    computerIntraCond(Succ, dst, visited, pathCondition);
-                }
-            }
-        }
-    }
-    visited[srcID] -= 1;
-    return;
-}
-
 expr VFGReachable::computerIntraCond(BasicBlock *src, BasicBlock *dst) {
     // outs() << src->getParent() << " " << dst->getParent() << "\n";
     assert(src->getParent() == dst->getParent() && "Two Basic Blocks are not in the same function");
-    BBCond.clear();
-    if (FuncDomTree[src->getParent()].dominates(dst, src)) {
+    if (FuncDomTree.at(src->getParent()).dominates(dst, src)) {
         return getTrueCond();
     }
     if (!reachable(src, dst)) {
         return getFalseCond();
     }
-    BBCond.insert({src, getTrueCond()});
-    std::vector<int> visited(BBID.size(), 0);
-    std::vector<std::pair<BasicBlock *, int>> pathCond;
-    computerIntraCond(src, dst, visited, pathCond);
-    return BBCond.at(dst);
+    ++NumIntraCondQueries;
+    auto &Conds = getIntraConds(dst);
+    auto It = Conds.find(src);
+    return It == Conds.end() ? getFalseCond() : It->second;
+}
+
+const std::map<BasicBlock *, expr> &VFGReachable::getIntraConds(BasicBlock *dst) {
+    auto &Cache = local().IntraCondCache;
+    auto CacheIt = Cache.find(dst);
+    if (CacheIt != Cache.end())
+        return CacheIt->second;
+    ++NumIntraCondComputed;
+
+    // the condition of a block is the disjunction of (branch condition && condition of successor) over its successors,
+    // which is computed once for all blocks in the order of sccs, so that the successors out of an scc are done first
+    auto &Conds = Cache[dst];
+    CFG *Ctrl = CFGMap.at(dst->getParent()).get();
+    auto &Order = Ctrl->sccOrder();
+    unsigned DstSCC = Ctrl->getSCC(dst);
+    unsigned K = 0;
+    // the sccs before that of dst cannot reach it
+    while (Ctrl->getSCC(Order[K]) != DstSCC)
+        ++K;
+    while (K < Order.size()) {
+        unsigned SCC = Ctrl->getSCC(Order[K]);
+        unsigned End = K + 1;
+        while (End < Order.size() && Ctrl->getSCC(Order[End]) == SCC)
+            ++End;
+
+        if (!Ctrl->inCycle(Order[K])) {
+            auto *BB = Order[K];
+            expr Cond = getFalseCond();
+            if (BB == dst) {
+                Cond = getTrueCond();
+            }
+            else {
+                int Idx = 0;
+                for (auto *Succ : successors(BB)) {
+                    auto SuccIt = Conds.find(Succ);
+                    if (SuccIt != Conds.end())
+                        Cond = disj(Cond, conj(getBranchConds(BB)[Idx], SuccIt->second));
+                    Idx++;
+                }
+            }
+            if (!Cond.is_false())
+                Conds.insert({BB, Cond});
+        }
+        else if (SCC != DstSCC) {
+            // a branch in a cycle may go either way in different iterations and the cycle is assumed to terminate,
+            // so the exits of a cycle are not conditioned by its branches
+            expr Cond = getFalseCond();
+            for (unsigned I = K; I < End; ++I) {
+                for (auto *Succ : successors(Order[I])) {
+                    auto SuccIt = Conds.find(Succ);
+                    if (SuccIt != Conds.end() && Ctrl->getSCC(Succ) != SCC)
+                        Cond = disj(Cond, SuccIt->second);
+                }
+            }
+            if (!Cond.is_false())
+                for (unsigned I = K; I < End; ++I)
+                    Conds.insert({Order[I], Cond});
+        }
+        else {
+            // in the cycle of dst, a path that goes around is split at the last back edge it takes, where the branches
+            // before may go either way in different iterations and are not conditioned, while the rest of the path is
+            // acyclic. so the conditions are computed on the scc without the back edges of a dfs from its entry, and
+            // a block also reaches dst under the condition of any back edge target, which every block can reach
+            BasicBlock *Entry = Order[K];
+            for (unsigned I = K; I < End; ++I) {
+                if (any_of(predecessors(Order[I]), [&](BasicBlock *Pred) { return Ctrl->getSCC(Pred) != SCC; })) {
+                    Entry = Order[I];
+                    break;
+                }
+            }
+            // the blocks in the post order of the dfs, so that an edge to a block not before is a back edge
+            const unsigned Unvisited = ~0U;
+            DenseMap<BasicBlock *, unsigned> PostNum;
+            std::vector<BasicBlock *> PostOrder;
+            std::vector<std::pair<BasicBlock *, succ_iterator>> DFSStack;
+            PostNum[Entry] = Unvisited;
+            DFSStack.emplace_back(Entry, succ_begin(Entry));
+            while (!DFSStack.empty()) {
+                auto *BB = DFSStack.back().first;
+                auto &SuccIt = DFSStack.back().second;
+                if (SuccIt != succ_end(BB)) {
+                    auto *Succ = *SuccIt++;
+                    if (Ctrl->getSCC(Succ) == SCC && PostNum.insert({Succ, Unvisited}).second)
+                        DFSStack.emplace_back(Succ, succ_begin(Succ));
+                    continue;
+                }
+                PostNum[BB] = PostOrder.size();
+                PostOrder.push_back(BB);
+                DFSStack.pop_back();
+            }
+            assert(PostOrder.size() == End - K);
+
+            // the exits of the cycle of dst cannot reach it
+            std::vector<expr> Acyclic;
+            for (unsigned I = 0; I < PostOrder.size(); ++I) {
+                auto *BB = PostOrder[I];
+                expr Cond = getFalseCond();
+                if (BB == dst) {
+                    Cond = getTrueCond();
+                }
+                else {
+                    int Idx = 0;
+                    for (auto *Succ : successors(BB)) {
+                        if (Ctrl->getSCC(Succ) == SCC && PostNum.lookup(Succ) < I)
+                            Cond = disj(Cond, conj(getBranchConds(BB)[Idx], Acyclic[PostNum.lookup(Succ)]));
+                        Idx++;
+                    }
+                }
+                Acyclic.push_back(Cond);
+            }
+
+            expr LoopCond = getFalseCond();
+            BitVector IsTarget(PostOrder.size());
+            for (unsigned I = 0; I < PostOrder.size(); ++I) {
+                for (auto *Succ : successors(PostOrder[I])) {
+                    if (Ctrl->getSCC(Succ) != SCC || PostNum.lookup(Succ) < I || IsTarget[PostNum.lookup(Succ)])
+                        continue;
+                    IsTarget.set(PostNum.lookup(Succ));
+                    LoopCond = disj(LoopCond, Acyclic[PostNum.lookup(Succ)]);
+                }
+            }
+            for (unsigned I = 0; I < PostOrder.size(); ++I) {
+                expr Cond = disj(Acyclic[I], LoopCond);
+                if (!Cond.is_false())
+                    Conds.insert({PostOrder[I], Cond});
+            }
+        }
+        K = End;
+    }
+    return Conds;
 }
 
 expr VFGReachable::computerCallCond(BasicBlock *src, BasicBlock *dst, const Call *CallSite) {
@@ -269,7 +398,7 @@ expr VFGReachable::computerCallCond(BasicBlock *src, BasicBlock *dst, const Call
     if (entry.getParent() == dst->getParent()) {
         expr entry_to_dst = computerIntraCond(&entry, dst);
     }
-    return src_to_mid && entry_to_dst;
+    return conj(src_to_mid, entry_to_dst);
 }
 expr VFGReachable::computerRetCond(BasicBlock *src, BasicBlock *dst, const Call *CallSite) {
     expr src_to_ret = getFalseCond();
@@ -284,7 +413,7 @@ expr VFGReachable::computerRetCond(BasicBlock *src, BasicBlock *dst, const Call
             if (src->getParent() == (*RetBBIt)->getParent()) {
                 expr src_to_ret_i = computerIntraCond(src, *RetBBIt);
             }
-            src_to_ret = (src_to_ret || src_to_ret_i);
+            src_to_ret = disj(src_to_ret, src_to_ret_i);
         }
     }
 
@@ -293,5 +422,5 @@ expr VFGReachable::computerRetCond(BasicBlock *src, BasicBlock *dst, const Call
     if (mid->getParent() == dst->getParent()) {
         expr mid_to_dst = computerIntraCond(mid, dst);
     }
-    return src_to_ret && mid_to_dst;
+    return conj(src_to_ret, mid_to_dst);
 }
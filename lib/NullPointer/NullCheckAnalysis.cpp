@@ -52,15 +52,16 @@ bool NullCheckAnalysis::runOnModule(Module &M) {
     unsigned Count = 1;
     do {
         RecursiveTimer Iteration("NCA Iteration " + std::to_string(Count));
+        ThreadPool::TaskGroup Group;
         for (auto &F: M) {
             if (!Funcs.count(&F)) continue;
-            ThreadPool::get()->enqueue([this, NFA, &F]() {
+            ThreadPool::get()->enqueue(Group, [this, NFA, &F]() {
                 auto *&LNCA = AnalysisMap.at(&F);
                 if (!LNCA) LNCA = new LocalNullCheckAnalysis(NFA, &F);
                 LNCA->run();
             });
         }
-        ThreadPool::get()->wait(); // wait for all tasks to finish
+        ThreadPool::get()->wait(Group); // wait for all tasks of this iteration to finish
         Funcs.clear();
     } while (Count++ < Round.getValue() && NFA->recompute(Funcs));
 
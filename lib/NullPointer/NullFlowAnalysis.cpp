@@ -85,7 +85,7 @@ bool NullFlowAnalysis::runOnModule(Module &M) {
         DFSStack.pop_back();
         if (Visited.count(Top)) continue;
         Visited.insert(Top);
-        for (auto &T: *Top) if (!Visited.count(T.first)) DFSStack.push_back(T.first);
+        for (auto T: *Top) if (!Visited.count(T.first)) DFSStack.push_back(T.first);
     }
 
     // get initial non null nodes
@@ -134,7 +134,7 @@ bool NullFlowAnalysis::recompute(std::set<Function *> &NewNonNullFunctions) {
             NonNullNodes.insert(N);
             if (auto *NF = N->getFunction()) NewNonNullFunctions.insert(NF);
         }
-        for (auto &T: *N) WorkList.push_back(T.first);
+        for (auto T: *N) WorkList.push_back(T.first);
     }
     return OrigNonNullSize != NonNullNodes.size();
 }
@@ -180,6 +180,6 @@ void NullFlowAnalysis::add(Function *F, Value *Ret) {
     auto *RetN = VFG->getVFGNode(Ret);
     if (!RetN) return;
     auto &Set = NewNonNullEdges.at(F);
-    for (auto &TargetIt: *RetN)
+    for (auto TargetIt: *RetN)
         Set.emplace(RetN, TargetIt.first);
 }
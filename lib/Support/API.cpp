@@ -18,6 +18,7 @@
 
 #include "Support/API.h"
 #include "Support/RNameDemangle.h"
+#include "Support/ThreadPool.h"
 #include "llvm/IR/Argument.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instruction.h"
@@ -69,6 +70,52 @@ std::map<std::string, int> API::RustSinkFunctionsForC = {
     {"core::ptr::drop_in_place", 0}
 };
 
+/// the number of functions classified by a task
+static const unsigned ChunkSize = 256;
+
+DenseMap<const Function *, API::FunctionRoles> API::Roles;
+
+Module *API::ClassifiedModule = nullptr;
+
+API::FunctionRoles API::classify(const Function *F) {
+    FunctionRoles R;
+    R.HeapAlloc = HeapAllocFunctions.count(F->getName().str());
+    std::string FuncName = RNameDemangle::legacyDemangle(F->getName().str());
+    auto SinkPoint = RustSinkFunctionsForC.find(FuncName);
+    if (SinkPoint != RustSinkFunctionsForC.end() && (unsigned) SinkPoint->second < F->arg_size())
+        R.SinkArg = SinkPoint->second;
+    return R;
+}
+
+void API::classifyFunctions(Module *M) {
+    std::vector<Function *> Funcs;
+    for (auto &F: *M) Funcs.push_back(&F);
+
+    // each task classifies a chunk of functions into its own slots
+    std::vector<FunctionRoles> Results(Funcs.size());
+    ThreadPool::TaskGroup Group;
+    for (unsigned Begin = 0; Begin < Funcs.size(); Begin += ChunkSize) {
+        ThreadPool::get()->enqueue(Group, [&Funcs, &Results, Begin]() {
+            for (unsigned K = Begin; K < Funcs.size() && K < Begin + ChunkSize; ++K) Results[K] = classify(Funcs[K]);
+        });
+    }
+    ThreadPool::get()->wait(Group);
+
+    Roles.clear();
+    Roles.reserve(Funcs.size());
+    for (unsigned K = 0; K < Funcs.size(); ++K) Roles[Funcs[K]] = Results[K];
+    ClassifiedModule = M;
+}
+
+void API::addHeapAllocFunction(StringRef Name) {
+    HeapAllocFunctions.insert(Name.str());
+    if (!ClassifiedModule) return;
+    if (auto *F = ClassifiedModule->getFunction(Name)) {
+        auto It = Roles.find(F);
+        if (It != Roles.end()) It->second.HeapAlloc = true;
+    }
+}
+
 bool API::isMemoryAllocate(Instruction *I) {
     return isHeapAllocate(I) || isStackAllocate(I);
 }
@@ -76,6 +123,8 @@ bool API::isMemoryAllocate(Instruction *I) {
 bool API::isHeapAllocate(Instruction *I) {
     if (auto CI = dyn_cast<CallInst>(I)) {
         if (auto Callee = CI->getCalledFunction()) {
+            auto It = Roles.find(Callee);
+            if (It != Roles.end()) return It->second.HeapAlloc;
             return HeapAllocFunctions.count(Callee->getName().str());
         }
     }
@@ -88,10 +137,7 @@ bool API::isStackAllocate(Instruction *I) {
 
 bool API::isRustSinkForC(Argument *Arg) {
     Function *Func = Arg->getParent();
-    std::string FuncName = RNameDemangle::legacyDemangle(Func->getName().str());
-    auto SinkPoint = RustSinkFunctionsForC.find(FuncName);
-    if (SinkPoint == RustSinkFunctionsForC.end()) {
-        return false;
-    }
-    return Func->getArg(SinkPoint->second) == Arg;
+    auto It = Roles.find(Func);
+    int SinkArg = It != Roles.end() ? It->second.SinkArg : classify(Func).SinkArg;
+    return SinkArg >= 0 && Func->getArg(SinkArg) == Arg;
 }
@@ -16,71 +16,160 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <llvm/ADT/STLExtras.h>
 #include <llvm/IR/CFG.h>
 #include "Support/CFG.h"
+#include <algorithm>
 
-CFG::CFG(Function *F) : AnalyzedVec(F->size(), false) {
-    ReachableVecPtr = new ReachableVec[F->size()];
-    int Idx = 0;
-    for (auto &B: *F) {
-        ID2BB.push_back(&B);
-        BB2ID[&B] = Idx;
-        ReachableVecPtr[Idx].resize(F->size(), false);
-        ++Idx;
+CFG::CFG(Function *F) {
+    std::vector<BasicBlock *> ID2BB;
+    DenseMap<const BasicBlock *, unsigned> BB2ID;
+    for (auto &BB : *F) {
+        BB2ID[&BB] = ID2BB.size();
+        ID2BB.push_back(&BB);
     }
-}
 
-CFG::~CFG() {
-    delete[] ReachableVecPtr;
+    // tarjan's algorithm, which also covers the blocks unreachable from the entry,
+    // numbers an scc after all sccs reachable from it
+    const unsigned NumBBs = ID2BB.size();
+    const unsigned Unvisited = ~0U;
+    std::vector<unsigned> DFSNum(NumBBs, Unvisited), LowLink(NumBBs);
+    std::vector<unsigned> SCCStack;
+    BitVector OnStack(NumBBs);
+    std::vector<std::pair<unsigned, succ_iterator>> DFSStack;
+    unsigned NextDFSNum = 0, NumSCCs = 0;
+    auto Visit = [&](unsigned ID) {
+        DFSNum[ID] = LowLink[ID] = NextDFSNum++;
+        SCCStack.push_back(ID);
+        OnStack.set(ID);
+        DFSStack.emplace_back(ID, succ_begin(ID2BB[ID]));
+    };
+    for (unsigned Root = 0; Root < NumBBs; ++Root) {
+        if (DFSNum[Root] != Unvisited) continue;
+        Visit(Root);
+        while (!DFSStack.empty()) {
+            unsigned ID = DFSStack.back().first;
+            auto &SuccIt = DFSStack.back().second;
+            if (SuccIt != succ_end(ID2BB[ID])) {
+                unsigned SuccID = BB2ID.lookup(*SuccIt++);
+                if (DFSNum[SuccID] == Unvisited) Visit(SuccID);
+                else if (OnStack[SuccID]) LowLink[ID] = std::min(LowLink[ID], DFSNum[SuccID]);
+                continue;
+            }
+            DFSStack.pop_back();
+            if (!DFSStack.empty()) {
+                unsigned Parent = DFSStack.back().first;
+                LowLink[Parent] = std::min(LowLink[Parent], LowLink[ID]);
+            }
+            if (LowLink[ID] != DFSNum[ID]) continue;
+            unsigned Member;
+            unsigned Size = 0;
+            do {
+                Member = SCCStack.back();
+                SCCStack.pop_back();
+                OnStack.reset(Member);
+                BB2SCC[ID2BB[Member]] = NumSCCs;
+                SCCOrder.push_back(ID2BB[Member]);
+                ++Size;
+            } while (Member != ID);
+            CyclicSCC.push_back(Size > 1 || is_contained(successors(ID2BB[ID]), ID2BB[ID]));
+            ++NumSCCs;
+        }
+    }
+
+    std::vector<std::vector<unsigned>> SCCSuccs(NumSCCs);
+    std::vector<bool> HasPred(NumSCCs, false);
+    for (auto *BB : ID2BB) {
+        unsigned From = BB2SCC.lookup(BB);
+        for (auto *Succ : successors(BB)) {
+            unsigned To = BB2SCC.lookup(Succ);
+            if (To == From) continue;
+            SCCSuccs[From].push_back(To);
+            HasPred[To] = true;
+        }
+    }
+
+    // number the sccs in the post order of a dfs from the sources, where the subtree of an scc
+    // covers the numbers from the one that is next when the scc is discovered to its own
+    PostOrder.assign(NumSCCs, Unvisited);
+    std::vector<unsigned> SubtreeBegin(NumSCCs, Unvisited);
+    std::vector<std::pair<unsigned, unsigned>> SCCDFSStack;
+    unsigned NextPostOrder = 0;
+    for (unsigned Root = NumSCCs; Root-- > 0;) {
+        if (HasPred[Root]) continue;
+        SubtreeBegin[Root] = NextPostOrder;
+        SCCDFSStack.emplace_back(Root, 0);
+        while (!SCCDFSStack.empty()) {
+            unsigned SCC = SCCDFSStack.back().first;
+            unsigned &SuccIdx = SCCDFSStack.back().second;
+            if (SuccIdx < SCCSuccs[SCC].size()) {
+                unsigned Succ = SCCSuccs[SCC][SuccIdx++];
+                if (SubtreeBegin[Succ] != Unvisited) continue;
+                SubtreeBegin[Succ] = NextPostOrder;
+                SCCDFSStack.emplace_back(Succ, 0);
+                continue;
+            }
+            PostOrder[SCC] = NextPostOrder++;
+            SCCDFSStack.pop_back();
+        }
+    }
+    assert(NextPostOrder == NumSCCs);
+
+    // the intervals of an scc merge its subtree with the intervals of its successors, which are computed before it
+    IntervalStart.reserve(NumSCCs + 1);
+    std::vector<std::pair<unsigned, unsigned>> Merged;
+    for (unsigned SCC = 0; SCC < NumSCCs; ++SCC) {
+        IntervalStart.push_back(Intervals.size());
+        Merged.clear();
+        Merged.emplace_back(SubtreeBegin[SCC], PostOrder[SCC]);
+        for (unsigned Succ : SCCSuccs[SCC]) {
+            assert(Succ < SCC);
+            Merged.insert(Merged.end(), Intervals.begin() + IntervalStart[Succ],
+                          Intervals.begin() + IntervalStart[Succ + 1]);
+        }
+        std::sort(Merged.begin(), Merged.end());
+        for (auto &I : Merged) {
+            if (Intervals.size() > IntervalStart.back() && I.first <= Intervals.back().second + 1)
+                Intervals.back().second = std::max(Intervals.back().second, I.second);
+            else
+                Intervals.push_back(I);
+        }
+    }
+    IntervalStart.push_back(Intervals.size());
+    Intervals.shrink_to_fit();
+
+    // comesBefore numbers the instructions of a block on demand, which is done here so that queries do not write
+    for (auto *BB : ID2BB)
+        if (!BB->isInstrOrderValid()) BB->renumberInstructions();
 }
 
-bool CFG::reachable(BasicBlock *From, BasicBlock *To) {
+CFG::~CFG() = default;
+
+bool CFG::reachable(BasicBlock *From, BasicBlock *To) const {
     assert(From && To);
     if (From == To) return true;
 
-    assert(BB2ID.count(To) && BB2ID.count(From));
-    const unsigned DstBlockID = BB2ID.at(To);
-    // If we haven't AnalyzedVect the destination node, run the analysis now
-    if (!AnalyzedVec[DstBlockID]) {
-        analyze(To);
-        AnalyzedVec[DstBlockID] = true;
-    }
-
-    // return the result from the cache
-    return ReachableVecPtr[DstBlockID][BB2ID.at(From)];
+    assert(BB2SCC.count(To) && BB2SCC.count(From));
+    unsigned FromSCC = BB2SCC.lookup(From);
+    unsigned ToSCC = BB2SCC.lookup(To);
+    // two different blocks in the same scc must be in a cycle
+    if (FromSCC == ToSCC) return true;
+    unsigned ToPostOrder = PostOrder[ToSCC];
+    auto Begin = Intervals.begin() + IntervalStart[FromSCC], End = Intervals.begin() + IntervalStart[FromSCC + 1];
+    auto It = std::upper_bound(Begin, End, ToPostOrder,
+                               [](unsigned N, const std::pair<unsigned, unsigned> &I) { return N < I.first; });
+    return It != Begin && ToPostOrder <= std::prev(It)->second;
 }
 
-bool CFG::reachable(Instruction *From, Instruction *To) {
+bool CFG::reachable(Instruction *From, Instruction *To) const {
     assert(From && To);
     if (From == To) return true;
 
     auto *FromB = From->getParent();
     auto *ToB = To->getParent();
     if (FromB == ToB) {
-        while (From) {
-            From = From->getNextNode();
-            if (From == To) return true;
-        }
-        return false;
+        return From->comesBefore(To);
     } else {
         return reachable(FromB, ToB);
     }
 }
-
-void CFG::analyze(BasicBlock *ToBB) {
-    BitVector VisitedVec(AnalyzedVec.size());
-    ReachableVec &ToReachability = ReachableVecPtr[BB2ID[ToBB]];
-    std::vector<BasicBlock *> Worklist;
-    Worklist.push_back(ToBB);
-    bool FirstRun = true;
-    while (!Worklist.empty()) {
-        auto *BB = Worklist.back();
-        Worklist.pop_back();
-        unsigned BBID = BB2ID[BB];
-        if (VisitedVec[BBID]) continue;
-        VisitedVec[BBID] = true;
-        if (!FirstRun) ToReachability[BBID] = true;
-        else FirstRun = false;
-        for (auto *Pred : predecessors(BB)) Worklist.push_back(Pred);
-    }
-}
\ No newline at end of file
@@ -17,7 +17,7 @@
  */
 
 
-#include <unistd.h>
+#include <chrono>
 #include <llvm/Support/CommandLine.h>
 
 #include "Support/ThreadPool.h"
@@ -44,8 +44,11 @@ ThreadPool *ThreadPool::get() {
     return Threads;
 }
 
+/// the id of the worker running on this thread, or -1 if it is not a worker
+static thread_local int CurrentWorker = -1;
+
 // the constructor just launches the workers
-ThreadPool::ThreadPool() : IsStop(false) {
+ThreadPool::ThreadPool() : NextQueue(0), NumQueued(0), IsStop(false), NumSteals(0), IdleMicroseconds(0) {
     unsigned NCores = std::thread::hardware_concurrency();
     if (NumWorkers == 0) {
         // We do not fork any threads, just use the main thread
@@ -54,67 +57,131 @@ ThreadPool::ThreadPool() : IsStop(false) {
         NumWorkers.setValue(NCores <= 10 ? (NCores >= 2 ? NCores - 1 : 1) : 10);
     }
 
-    for (auto &Worker : Workers) {
-        ThreadLocals[Worker.get_id()] = nullptr;
-    }
-
-    NumRunningTask = 0;
+    for (unsigned I = 0; I < NumWorkers.getValue(); ++I)
+        Queues.emplace_back(new WorkerQueue);
 
     for (unsigned I = 0; I < NumWorkers.getValue(); ++I) {
-        Workers.emplace_back([this] {
+        Workers.emplace_back([this, I] {
             if (before_thread_start_hook) before_thread_start_hook();
-
-            for (;;) {
-                std::function<void()> Task;
-
-                {
-                    std::unique_lock<std::mutex> Lock(this->QueueMutex);
-                    this->Condition.wait(Lock, [this] {
-                        return this->IsStop || !this->TaskQueue.empty();
-                    });
-                    // If ThreadPool already stopped, return without checking
-                    // tasks.
-                    if (this->IsStop) { // && this->tasks.empty())
-                        if (after_thread_complete_hook) after_thread_complete_hook();
-                        return;
-                    }
-                    if (!this->TaskQueue.empty()) {
-                        Task = std::move(this->TaskQueue.front());
-                        this->TaskQueue.pop();
-                    }
-
-                    NumRunningTask++;
-                }
-
-                Task();
-
-                {
-                    std::unique_lock<std::mutex> Lock(this->QueueMutex);
-                    NumRunningTask--;
-                }
-            }
+            CurrentWorker = I;
+            run(I);
+            if (after_thread_complete_hook) after_thread_complete_hook();
         });
     }
 }
 
-void ThreadPool::wait() {
-    while (true) {
-        {
-            std::unique_lock<std::mutex> Lock(this->QueueMutex);
-            if (TaskQueue.empty() && NumRunningTask == 0) {
-                break;
-            }
+void ThreadPool::run(unsigned WorkerID) {
+    for (;;) {
+        std::function<void()> Task;
+        if (pop(WorkerID, Task)) {
+            Task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> Lock(SleepMutex);
+        auto IdleStart = std::chrono::steady_clock::now();
+        WorkAvailable.wait(Lock, [this] { return IsStop || NumQueued > 0; });
+        IdleMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - IdleStart).count();
+        // If ThreadPool already stopped, return without checking tasks.
+        if (IsStop)
+            return;
+    }
+}
+
+void ThreadPool::push(std::function<void()> Task) {
+    // a worker pushes to its own queue, so that the tasks it spawns stay local
+    unsigned Target = CurrentWorker >= 0 ? (unsigned) CurrentWorker : NextQueue++ % Queues.size();
+    // count the task before publishing it, so that the pop taking it never decrements below zero
+    {
+        std::unique_lock<std::mutex> Lock(SleepMutex);
+        ++NumQueued;
+    }
+    {
+        std::unique_lock<std::mutex> Lock(Queues[Target]->Mutex);
+        Queues[Target]->Tasks.push_back(std::move(Task));
+    }
+    WorkAvailable.notify_one();
+}
+
+bool ThreadPool::pop(unsigned WorkerID, std::function<void()> &Task) {
+    {
+        auto &Own = *Queues[WorkerID];
+        std::unique_lock<std::mutex> Lock(Own.Mutex);
+        if (!Own.Tasks.empty()) {
+            Task = std::move(Own.Tasks.back());
+            Own.Tasks.pop_back();
+            --NumQueued;
+            return true;
         }
-        usleep(10000);
+    }
+    for (unsigned K = 1; K < Queues.size(); ++K) {
+        auto &Victim = *Queues[(WorkerID + K) % Queues.size()];
+        std::unique_lock<std::mutex> Lock(Victim.Mutex);
+        if (!Victim.Tasks.empty()) {
+            Task = std::move(Victim.Tasks.front());
+            Victim.Tasks.pop_front();
+            --NumQueued;
+            ++NumSteals;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::start(TaskGroup *Group) {
+    {
+        std::unique_lock<std::mutex> Lock(AllTasks.Mutex);
+        ++AllTasks.NumPending;
+    }
+    if (Group) {
+        std::unique_lock<std::mutex> Lock(Group->Mutex);
+        ++Group->NumPending;
+    }
+}
+
+void ThreadPool::finish(TaskGroup *Group) {
+    // the group may be destroyed once its waiter wakes up, so it is released before the pool
+    if (Group) {
+        std::unique_lock<std::mutex> Lock(Group->Mutex);
+        if (--Group->NumPending == 0)
+            Group->Done.notify_all();
+    }
+    std::unique_lock<std::mutex> Lock(AllTasks.Mutex);
+    if (--AllTasks.NumPending == 0)
+        AllTasks.Done.notify_all();
+}
+
+void ThreadPool::wait() {
+    // the task calling it is pending itself, so a worker would wait forever
+    assert(CurrentWorker < 0 && "wait() cannot be called from a worker");
+    wait(AllTasks);
+}
+
+void ThreadPool::wait(TaskGroup &Group) {
+    std::unique_lock<std::mutex> Lock(Group.Mutex);
+    if (CurrentWorker < 0) {
+        Group.Done.wait(Lock, [&Group] { return Group.NumPending == 0; });
+        return;
+    }
+
+    // a worker runs tasks while waiting, since the tasks of a nested group may be queued behind it
+    while (Group.NumPending) {
+        Lock.unlock();
+        std::function<void()> Task;
+        bool Popped = pop(CurrentWorker, Task);
+        if (Popped) Task();
+        Lock.lock();
+        if (!Popped) Group.Done.wait_for(Lock, std::chrono::milliseconds(1));
     }
 }
 
 ThreadPool::~ThreadPool() { // the destructor shall join all threads
     {
-        std::unique_lock<std::mutex> Lock(QueueMutex);
+        std::unique_lock<std::mutex> Lock(SleepMutex);
         IsStop = true;
     }
-    Condition.notify_all();
+    WorkAvailable.notify_all();
     for (std::thread &Worker : Workers) {
         Worker.join();
     }